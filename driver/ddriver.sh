@@ -18,8 +18,10 @@ fi
 
 cd "$WORK_DIR" || exit
 
-CONFIG_BLOCK_SZ=512
-BLOCK_COUNT=8192
+# 设备几何参数，可在安装前通过环境变量修改，单位字节
+CONFIG_BLOCK_SZ=${DDRIVER_IO_SZ:-512}
+CONFIG_DISK_SZ=${DDRIVER_DISK_SZ:-4194304}
+BLOCK_COUNT=$((CONFIG_DISK_SZ / CONFIG_BLOCK_SZ))
 
 
 function usage(){
@@ -41,6 +43,10 @@ function usage(){
     echo "-l            显示ddriver的Log"
     echo "-v            显示ddriver的类型[内核模块 / 用户静态链接库]"
     echo "-h            打印本帮助菜单"
+    echo "环境变量: "
+    echo "DDRIVER_DISK_SZ   磁盘大小[字节], 默认4194304 (4MiB)"
+    echo "DDRIVER_IO_SZ     IO单位大小[字节], 默认512, 需为2的幂"
+    echo "DDRIVER_PROFILE   延迟模型[default / hdd / ssd / nvme / none], 默认default, 仅用户静态链接库"
     echo "===================================================================="
 }
 
@@ -80,7 +86,7 @@ function install() {
         sudo rm $KERNEL_DEV_PATH>/dev/null 2>&1 
         sudo rmmod ddriver>/dev/null 2>&1 
         sudo dmesg -C
-        sudo insmod ./ddriver.ko
+        sudo insmod ./ddriver.ko disk_size="$CONFIG_DISK_SZ" io_size="$CONFIG_BLOCK_SZ"
         in=$(dmesg | tail -n 1)
         tokens=("$in")
         major_number=${tokens[${#tokens[*]}-1]}
@@ -93,6 +99,8 @@ function install() {
         source "$HOME"/.bashrc   
 
         echo "export DDRIVER_TYPE='k'" >>"$HOME"/.bashrc
+        echo "export DDRIVER_DISK_SZ=$CONFIG_DISK_SZ" >>"$HOME"/.bashrc
+        echo "export DDRIVER_IO_SZ=$CONFIG_BLOCK_SZ" >>"$HOME"/.bashrc
         source "$HOME"/.bashrc
         cd ..
     else 
@@ -111,6 +119,8 @@ function install() {
         source "$HOME"/.bashrc     
         
         echo "export DDRIVER_TYPE='u'" >>"$HOME"/.bashrc
+        echo "export DDRIVER_DISK_SZ=$CONFIG_DISK_SZ" >>"$HOME"/.bashrc
+        echo "export DDRIVER_IO_SZ=$CONFIG_BLOCK_SZ" >>"$HOME"/.bashrc
         source "$HOME"/.bashrc
 
         cd "$LAST_DIR" || exit
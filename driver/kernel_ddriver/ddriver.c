@@ -2,6 +2,13 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/moduleparam.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
 #include "ddriver_ctl.h"
@@ -27,23 +34,17 @@
                         "filp_open/cpp-filp_open-function-examples.html>"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
-#define CONFIG_BLOCK_SZ (512)
+#define CONFIG_DISK_SZ  (4 * 1024 * 1024)   /* Default, override with disk_size= */
+#define CONFIG_BLOCK_SZ (512)               /* Default, override with io_size= */
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
 #define IGNORE_ARG(arg)         ((void)arg)
-#define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
-#define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
+#define IS_ADDR_ALIGN(addr)     ((addr) % disk.iounit_size == 0)
+#define ADDR_ROUND_UP(addr)     (((addr) / disk.iounit_size) * disk.iounit_size)
 
-#define GET_HEAD_POS(disk)      (disk.head - disk.layout)
-#define FORWARD_HEAD(disk, dis) (disk.head += dis)
-#define SET_HEAD(disk, ofs)     (disk.head = disk.layout + ofs)
-#define RESET_HEAD(disk)        (SET_HEAD(disk, 0))
-
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define GET_LAST_POS(file)      ((loff_t)(uintptr_t)(file)->private_data)
+#define SET_LAST_POS(file, ofs) ((file)->private_data = (void *)(uintptr_t)(ofs))
 /******************************************************************************
 * SECTION: Kernel Module Template
 *******************************************************************************/
@@ -51,46 +52,99 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR(DRIVER_AUTHOR);	    
 MODULE_DESCRIPTION(DRIVER_DESC);	
 MODULE_VERSION(DRIVER_VERSION);	
+
+static unsigned long disk_size = CONFIG_DISK_SZ;
+module_param(disk_size, ulong, 0444);
+MODULE_PARM_DESC(disk_size, "Disk size in bytes, multiple of io_size");
+static unsigned int io_size = CONFIG_BLOCK_SZ;
+module_param(io_size, uint, 0444);
+MODULE_PARM_DESC(io_size, "IO unit in bytes, power of 2 and >= 512");
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
-    char layout[CONFIG_DISK_SZ];                      /* Disk Layout */
-    char *head;                                       /* Disk Head */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
+    char *layout;                                     /* Disk Layout, vmalloc'ed at load */
+    struct ddriver_state_ex stats;                    /* 64-bit counters and histograms */
+    spinlock_t stats_lock;
     int  major_num;
     int  open_count;
-    int  layout_size;
-    int  iounit_size;
+    u64  layout_size;
+    u64  iounit_size;
 };
 
 static struct ddriver disk = {
-    .head        = NULL,
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
+    .stats_lock  = __SPIN_LOCK_UNLOCKED(disk.stats_lock),
     .major_num   = 0,
     .open_count  = 0,
+    .layout      = NULL,
     .layout_size = CONFIG_DISK_SZ,
     .iounit_size = CONFIG_BLOCK_SZ
 };
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
-int check_valid(size_t size){
-    if (GET_HEAD_POS(disk) >=  CONFIG_DISK_SZ) {
+int check_valid(loff_t pos, size_t size){
+    if (pos < 0 || pos >= disk.layout_size) {
         kernel_alert("disk head reach the end");
         return -EINVAL;
     }
-    if (size != CONFIG_BLOCK_SZ){
-        kernel_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
+    if (!IS_ADDR_ALIGN(pos)) {
+        kernel_alert("offset %lld must be aligned to block size %llu", 
+                      pos, disk.iounit_size);
+        return -EINVAL;
+    }
+    if (size != disk.iounit_size){
+        kernel_alert("io size %ld should align to %llu", size, disk.iounit_size);
         return -EIO;
     }
     return 0;
 }
+int hist_bucket(u64 val){
+    if (val == 0)
+        return 0;
+    return min_t(int, ilog2(val), DDRIVER_HIST_BUCKETS - 1);
+}
+/**
+ * @brief Account a finished request. It is a seek when it does not start 
+ *        where the previous request of the same opener ended
+ * 
+ * @param file          Opener
+ * @param is_write      Request direction
+ * @param pos           Start of the request
+ * @param start_ns      When the request entered the driver
+ */
+void track_io(struct file *file, bool is_write, loff_t pos, u64 start_ns){
+    struct ddriver_state_ex *st = &disk.stats;
+    loff_t last = GET_LAST_POS(file);
+    int lat = hist_bucket(div_u64(ktime_get_ns() - start_ns, 1000));
+    int region = div64_u64((u64)pos * DDRIVER_HEAT_REGIONS, disk.layout_size);
+
+    spin_lock(&disk.stats_lock);
+    if (last == pos) {
+        st->seq_cnt++;
+    }
+    else {
+        st->seek_cnt++;
+        st->rand_cnt++;
+        st->seek_dist_hist[hist_bucket(div64_u64(abs(pos - last), 
+                                                 disk.iounit_size))]++;
+    }
+    if (is_write) {
+        st->write_cnt++;
+        st->write_bytes += disk.iounit_size;
+        st->write_lat_hist[lat]++;
+        st->region_write[region]++;
+    }
+    else {
+        st->read_cnt++;
+        st->read_bytes += disk.iounit_size;
+        st->read_lat_hist[lat]++;
+        st->region_read[region]++;
+    }
+    spin_unlock(&disk.stats_lock);
+    SET_LAST_POS(file, pos + disk.iounit_size);
+}
 /******************************************************************************
 * SECTION: Function definitions
 *******************************************************************************/
@@ -117,77 +171,81 @@ static struct file_operations file_ops = {
 /**
  * @brief Disk Read
  * 
- * @param file          Ignored
+ * @param file          Opener, keeps its own last position
  * @param user_buffer   User space buffer
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param size          Must equal to IO unit @io_size
+ * @param offset        Position to read from, advanced by the bytes read.
+ *                      &file->f_pos for read(2), private for pread(2)
  * @return ssize_t      Bytes have been read 
  */
 static ssize_t 
 device_read(struct file *file, char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
-    IGNORE_ARG(file);
-    int res = check_valid(size);
+    u64 start_ns = ktime_get_ns();
+    loff_t pos = *offset;
+    int res = check_valid(pos, size);
     if(res < 0)
         return res;
-    if (copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ))
+    if (copy_to_user(user_buffer, disk.layout + pos, disk.iounit_size))
         return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
-    INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    track_io(file, false, pos, start_ns);
+    *offset = pos + disk.iounit_size;
+    return disk.iounit_size;
 }
 /**
  * @brief Disk Write
  * 
- * @param file          Ignored
+ * @param file          Opener, keeps its own last position
  * @param user_buffer   User space buffer, copy content from
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param size          Must equal to IO unit @io_size
+ * @param offset        Position to write to, advanced by the bytes written.
+ *                      &file->f_pos for write(2), private for pwrite(2)
  * @return ssize_t      Bytes have been written
  */
 static ssize_t 
 device_write(struct file *file, const char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
-    IGNORE_ARG(file);
-    int res = check_valid(size);
+    u64 start_ns = ktime_get_ns();
+    loff_t pos = *offset;
+    int res = check_valid(pos, size);
     if(res < 0)
         return res;
 
-    if (copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ))
+    if (copy_from_user(disk.layout + pos, user_buffer, disk.iounit_size))
         return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
-    INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    track_io(file, true, pos, start_ns);
+    *offset = pos + disk.iounit_size;
+    return disk.iounit_size;
 }
 /**
- * @brief Disk Seek
+ * @brief Disk Seek, only moves the file position of this opener
  * 
- * @param file          Ignored
- * @param offset        Aligned to @CONFIG_BLOCK_SZ
+ * @param file          Opener
+ * @param offset        Aligned to IO unit @io_size
  * @param whence        SEEK_CUR, SEEK_SET
  * @return loff_t       cur pos
  */
 static loff_t 
 device_seek(struct file *file, loff_t offset, int whence) {
-    IGNORE_ARG(file);
+    loff_t pos;
     if (!IS_ADDR_ALIGN(offset)) {
-        kernel_alert("offset %lld must be aligned to block size %d", 
-                      offset, CONFIG_BLOCK_SZ);
+        kernel_alert("offset %lld must be aligned to block size %llu", 
+                      offset, disk.iounit_size);
         return -EINVAL;
     }
     switch (whence)
     {
     case SEEK_SET:
-        SET_HEAD(disk, offset);
+        pos = offset;
         break;
     case SEEK_CUR:
-        FORWARD_HEAD(disk, offset);
+        pos = file->f_pos + offset;
         break;
     default:
-        break;
+        return -EINVAL;
     }
-    INC_SEEKCNT(disk);
-    return GET_HEAD_POS(disk);
+    if (pos < 0 || pos > disk.layout_size)
+        return -EINVAL;
+    file->f_pos = pos;
+    return pos;
 }
 /**
  * @brief Disk ioctl
@@ -199,35 +257,82 @@ device_seek(struct file *file, loff_t offset, int whence) {
  */
 static long 
 device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
-    IGNORE_ARG(file);
     int ret;
     struct ddriver_state state;
+    struct ddriver_state_ex *state_ex;
+    struct ddriver_range range;
+    u64 wcache;
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        ret = copy_to_user((int __user *)arg, &disk.layout_size, sizeof(int));
+        ret = copy_to_user((u64 __user *)arg, &disk.layout_size, sizeof(u64));
         if (ret) 
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        spin_lock(&disk.stats_lock);
+        state.read_cnt = disk.stats.read_cnt;
+        state.write_cnt = disk.stats.write_cnt;
+        state.seek_cnt = disk.stats.seek_cnt;
+        spin_unlock(&disk.stats_lock);
         ret = copy_to_user((int __user *)arg, &state, sizeof(struct ddriver_state));
         if (ret) 
             return -EFAULT;
         break;
+    case IOC_REQ_DEVICE_STATE_EX:                     /* Device State, 64-bit */
+        state_ex = kmalloc(sizeof(struct ddriver_state_ex), GFP_KERNEL);
+        if (state_ex == NULL)
+            return -ENOMEM;
+        spin_lock(&disk.stats_lock);                  /* Snapshot, can't copy_to_user under lock */
+        memcpy(state_ex, &disk.stats, sizeof(struct ddriver_state_ex));
+        spin_unlock(&disk.stats_lock);
+        ret = copy_to_user((void __user *)arg, state_ex, sizeof(struct ddriver_state_ex));
+        kfree(state_ex);
+        if (ret) 
+            return -EFAULT;
+        break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        disk.head = disk.layout;
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        file->f_pos = 0;
+        SET_LAST_POS(file, 0);
+        spin_lock(&disk.stats_lock);
+        memset(&disk.stats, 0, sizeof(struct ddriver_state_ex));
+        spin_unlock(&disk.stats_lock);
+        break;
+    case IOC_REQ_DEVICE_DISCARD:                      /* Discard Range, reads back zeros */
+        ret = copy_from_user(&range, (struct ddriver_range __user *)arg, 
+                             sizeof(struct ddriver_range));
+        if (ret) 
+            return -EFAULT;
+        if (range.size == 0 || !IS_ADDR_ALIGN(range.offset) || !IS_ADDR_ALIGN(range.size) ||
+            range.offset >= disk.layout_size || range.size > disk.layout_size - range.offset)
+            return -EINVAL;
+        memset(disk.layout + range.offset, 0, range.size);
+        spin_lock(&disk.stats_lock);
+        disk.stats.discard_cnt++;
+        disk.stats.discard_bytes += range.size;
+        spin_unlock(&disk.stats_lock);
+        break;
+    case IOC_REQ_FLUSH:                               /* Writes land in the layout directly, */
+        spin_lock(&disk.stats_lock);                  /* nothing volatile to drain */
+        disk.stats.wcache_flushes++;
+        spin_unlock(&disk.stats_lock);
         break;
     case IOC_REQ_DEVICE_IO_SZ:
-        ret = copy_to_user((int __user *)arg, &disk.iounit_size, sizeof(int));
+        ret = copy_to_user((u64 __user *)arg, &disk.iounit_size, sizeof(u64));
         if (ret) 
             return -EFAULT;
         break;
+    case IOC_REQ_DEVICE_CRASH:                        /* No volatile cache, nothing to lose: no-op */
+        break;
+    case IOC_REQ_DEVICE_WCACHE:                       /* No write cache, only "off" (0) is accepted */
+        ret = copy_from_user(&wcache, (u64 __user *)arg, sizeof(u64));
+        if (ret) 
+            return -EFAULT;
+        if (wcache != 0)
+            return -EOPNOTSUPP;
+        break;
+    case IOC_REQ_DEVICE_PROFILE:                      /* No latency models in the module */
+        return -EOPNOTSUPP;
     default:
         break;
     }
@@ -237,18 +342,18 @@ device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
  * @brief Disk Open
  * 
  * @param inode         Ignored
- * @param file          Ignored
+ * @param file          Opener, its last position is kept in private_data
  * @return int          state
  */
 static int 
 device_open(struct inode *inode, struct file *file) {
     IGNORE_ARG(inode);
-    IGNORE_ARG(file);
     
     if (disk.open_count) {                            /* If device is open, return busy */
         return -EBUSY;
     }
-    RESET_HEAD(disk);                                 /* Everytime close device, reset head */
+    file->f_pos = 0;                                  /* Everytime open device, reset head */
+    SET_LAST_POS(file, 0);
     disk.open_count++;
     try_module_get(THIS_MODULE);
     return 0;
@@ -276,16 +381,31 @@ device_release(struct inode *inode, struct file *file) {
 static int __init 
 ddriver_init(void)
 {
-    int major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
+    int major_num;
+    if (io_size < CONFIG_BLOCK_SZ || (io_size & (io_size - 1)) != 0 ||
+        disk_size == 0 || disk_size % io_size != 0) {
+        kernel_alert("bad geometry: disk_size %lu, io_size %u", disk_size, io_size);
+        return -EINVAL;
+    }
+    disk.layout_size = disk_size;
+    disk.iounit_size = io_size;
+    disk.layout = vzalloc(disk.layout_size);          /* Zeroed layout */
+    if (disk.layout == NULL) {
+        kernel_alert("Can't allocate %llu bytes for the disk", disk.layout_size);
+        return -ENOMEM;
+    }
+    kernel_info("disk size %llu, io unit %llu", disk.layout_size, disk.iounit_size);
+
+    major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
                                                       /* Register an device */
     if (major_num < 0) {                              /* Register fail */
         kernel_alert("Can't register device, ret %d", major_num);
+        vfree(disk.layout);
         return major_num;
     } 
     else {                                            /* Register success */                                                  
         kernel_info("module loaded with device major number %d", major_num);
         disk.major_num = major_num;
-        memset(disk.layout, 0, CONFIG_DISK_SZ);
         return 0;
     }
     return 0;
@@ -299,6 +419,7 @@ ddriver_exit(void)
     if(major_num != 0){
         unregister_chrdev(major_num, DEVICE_NAME);
     }
+    vfree(disk.layout);
 }
 
 module_init(ddriver_init);
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE                             /* fallocate */
 #include "stdio.h"
 #include "stdlib.h"
 #include <unistd.h>
@@ -6,10 +7,14 @@
 #include "string.h"
 #include <linux/fs.h>
 #include "ddriver_ctl.h"
+#include "include/ddriver.h"
 #include "stdio.h"
 #include "errno.h"
 #include <pwd.h>
 #include <time.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 extern int errno;
 
@@ -44,78 +49,621 @@ extern int errno;
 #define DRIVER_DESC     "A Fake disk driver in user space"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
-#define CONFIG_BLOCK_SZ (512)
+#define CONFIG_DISK_SZ  (4 * 1024 * 1024)   /* Default, override with $DDRIVER_DISK_SZ */
+#define CONFIG_BLOCK_SZ (512)               /* Default, override with $DDRIVER_IO_SZ */
+#define CONFIG_IOV_MAX  (1024)
+#define CONFIG_RING_SZ  (128)
+#define CONFIG_WORKERS  (4)             /* Requests served in parallel, i.e. device queue depth */
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
 #define IGNORE_ARG(arg)         ((void)arg)
-#define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
-#define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
+#define IS_ADDR_ALIGN(addr)     ((addr) % disk.iounit_size == 0)
+#define ADDR_ROUND_UP(addr)     (((addr) / disk.iounit_size) * disk.iounit_size)
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_STAT(field, n)      (__atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED))
+#define INC_SEEKCNT(disk)       (INC_STAT(disk.stats.seek_cnt, 1))
 
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
+#define PROFILE(disk)           (&profiles[disk.profile])
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
     int  ddriver_fd;                                 /* Disk ddriver_fd */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
-    int  read_lat;
+    struct ddriver_state_ex stats;                   /* 64-bit counters and histograms */
+    int  read_lat;                                   /* Default profile, in ms */
     int  write_lat;
     int  seek_lat;
     int  track_num;
+    int  profile;                                    /* DDRIVER_PROFILE_* */
     int  major_num;
-    int  layout_size;
-    int  iounit_size;
+    uint64_t layout_size;
+    uint64_t iounit_size;
+    char *map_base;                                  /* Whole image, mapped on first ddriver_map */
+};
+/* Latency model of a device class, in us */
+struct ddriver_profile
+{
+    const char *name;
+    int  read_us;                                    /* Fixed cost of a read request */
+    int  write_us;                                   /* Fixed cost of a write request */
+    int  mbps;                                       /* Media rate in MB/s, 0 = free */
+    int  seek_min_us;                                /* Track-to-track, 0 = no seek */
+    int  seek_max_us;                                /* Full stroke */
+    int  rpm;                                        /* 0 = no rotational latency */
+};
+/* Elevator sort key */
+struct sched_ent
+{
+    off_t offset;
+    int   idx;                                       /* Position in the submitted batch */
+};
+/* Device-side volatile write cache: dirty IO units are acknowledged before 
+   they reach the image, drained by IOC_REQ_FLUSH and lost on a crash */
+struct ddriver_wcache
+{
+    uint64_t  capacity;                              /* In IO units, 0 = write through */
+    uint64_t  dirty;                                 /* Units held */
+    char    **unit;                                  /* By unit number, NULL = not cached */
+    uint64_t *order;                                 /* Unit numbers as cached, may be stale */
+    uint64_t  order_cnt;
+    pthread_mutex_t lock;
+};
+/* Submission / completion rings served by a worker pool */
+struct ddriver_ring
+{
+    struct ddriver_io *sq[CONFIG_RING_SZ];
+    struct ddriver_io *cq[CONFIG_RING_SZ];
+    int  sq_head;
+    int  sq_cnt;
+    int  cq_head;
+    int  cq_cnt;
+    int  outstanding;                                /* Submitted but not reaped */
+    int  fd;
+    int  running;
+    pthread_t       workers[CONFIG_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t  sq_cond;
+    pthread_cond_t  cq_cond;
 };
 /******************************************************************************
 * SECTION: Global Variable
 *******************************************************************************/
 /* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
 struct ddriver disk = {
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
+    .stats       = {0},
     .read_lat    = 2,       /* 2ms */       
     .write_lat   = 1,       /* 1ms */
     .seek_lat    = 4,       /* 4.17ms per 360 degree */
     .major_num   = 0,
     .track_num   = 100,
+    .profile     = DDRIVER_PROFILE_DEFAULT,
     .layout_size = CONFIG_DISK_SZ,
-    .iounit_size = CONFIG_BLOCK_SZ
+    .iounit_size = CONFIG_BLOCK_SZ,
+    .map_base    = NULL
+};
+
+/* DEFAULT keeps the original fixed ms model above (read_lat, write_lat, seek_lat) */
+struct ddriver_profile profiles[] = {
+    [DDRIVER_PROFILE_DEFAULT] = { "default",   0,   0,    0,    0,     0,    0 },
+    [DDRIVER_PROFILE_HDD]     = { "hdd",     100, 100,  150, 1000, 15000, 7200 },
+    [DDRIVER_PROFILE_SSD]     = { "ssd",     100, 250,  500,    0,     0,    0 },
+    [DDRIVER_PROFILE_NVME]    = { "nvme",     20,  40, 3000,    0,     0,    0 },
+    [DDRIVER_PROFILE_NONE]    = { "none",      0,   0,    0,    0,     0,    0 },
+};
+
+struct ddriver_wcache wcache = {
+    .capacity    = 0,
+    .dirty       = 0,
+    .unit        = NULL,
+    .order       = NULL,
+    .order_cnt   = 0,
+    .lock        = PTHREAD_MUTEX_INITIALIZER
+};
+
+struct ddriver_ring ring = {
+    .sq_head     = 0,
+    .sq_cnt      = 0,
+    .cq_head     = 0,
+    .cq_cnt      = 0,
+    .outstanding = 0,
+    .fd          = -1,
+    .running     = 0,
+    .lock        = PTHREAD_MUTEX_INITIALIZER,
+    .sq_cond     = PTHREAD_COND_INITIALIZER,
+    .cq_cond     = PTHREAD_COND_INITIALIZER
 };
 
 FILE *debugf = NULL;
+/* Head position of the calling thread, used by positional IO */
+static __thread off_t last_pos = 0;
+/* End of the previous request of the calling thread, used by statistics */
+static __thread off_t last_end = 0;
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
+/* Geometry is fixed when the device is opened: $DDRIVER_DISK_SZ and 
+   $DDRIVER_IO_SZ in bytes, IO unit a power of two no smaller than 512 */
+int load_geometry(void) {
+    char *env;
+    uint64_t layout_size = CONFIG_DISK_SZ;
+    uint64_t iounit_size = CONFIG_BLOCK_SZ;
+
+    if ((env = getenv("DDRIVER_DISK_SZ")) != NULL) {
+        layout_size = strtoull(env, NULL, 0);
+    }
+    if ((env = getenv("DDRIVER_IO_SZ")) != NULL) {
+        iounit_size = strtoull(env, NULL, 0);
+    }
+    if (iounit_size < CONFIG_BLOCK_SZ || (iounit_size & (iounit_size - 1)) != 0) {
+        user_panic("io unit %ld must be a power of 2 and >= %d", 
+                   iounit_size, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    if (layout_size == 0 || layout_size % iounit_size != 0) {
+        user_panic("disk size %ld must be a multiple of io unit %ld", 
+                   layout_size, iounit_size);
+        return -EINVAL;
+    }
+    disk.layout_size = layout_size;
+    disk.iounit_size = iounit_size;
+    return 0;
+}
+
 int check_valid(size_t size) {
-    if (size != CONFIG_BLOCK_SZ){
-        user_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
+    if (size != disk.iounit_size){
+        user_alert("io size %ld should align to %ld", size, disk.iounit_size);
         return -EIO;
     }
     return 0;
 }
 
+int check_valid_iov(const struct iovec *iov, int iovcnt, size_t *total) {
+    int i;
+    *total = 0;
+    if (iovcnt <= 0 || iovcnt > CONFIG_IOV_MAX) {
+        user_alert("iovcnt %d out of range (1 ~ %d)", iovcnt, CONFIG_IOV_MAX);
+        return -EINVAL;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0 || !IS_ADDR_ALIGN(iov[i].iov_len)) {
+            user_alert("iov[%d] size %ld should align to %ld", 
+                       i, iov[i].iov_len, disk.iounit_size);
+            return -EIO;
+        }
+        *total += iov[i].iov_len;
+    }
+    return 0;
+}
+
+int check_valid_range(off_t offset, size_t size) {
+    if (!IS_ADDR_ALIGN(offset)) {
+        user_alert("offset %ld must be aligned to block size %ld", 
+                   offset, disk.iounit_size);
+        return -EINVAL;
+    }
+    if (offset < 0 || offset + size > disk.layout_size) {
+        user_alert("range [%ld, %ld) out of device", offset, offset + size);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/* $DDRIVER_PROFILE selects a latency model by name, see profiles[] */
+int load_profile(void) {
+    char *env = getenv("DDRIVER_PROFILE");
+    int i;
+    if (env == NULL) {
+        return 0;
+    }
+    for (i = 0; i < DDRIVER_PROFILE_NUM; i++) {
+        if (strcmp(env, profiles[i].name) == 0) {
+            disk.profile = i;
+            return 0;
+        }
+    }
+    user_panic("unknown profile %s", env);
+    return -EINVAL;
+}
+
+long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+long isqrt(long x) {
+    long r = 0, bit = 1L << 62;
+    while (bit > x) bit >>= 2;
+    while (bit != 0) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+/* Head movement from start to end: seek curve plus waiting for the
+   target sector to rotate under the head */
 int emulate_rotate(int fd, off_t start, off_t end) {
-    int bytes_per_track = disk.layout_size / disk.track_num;
-    int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
-    
-    if (distance == 0) {
+    struct ddriver_profile *p = PROFILE(disk);
+    off_t bytes_per_track = disk.layout_size / disk.track_num;
+    off_t lat_per_track = disk.seek_lat;
+    off_t distance = llabs(end - start) % bytes_per_track; 
+    long tracks, seek_us, period_us, angle_us, target_us;
+    IGNORE_ARG(fd);
+
+    if (disk.profile == DDRIVER_PROFILE_DEFAULT) {
+        if (distance == 0) {
+            return 0;
+        }
+        usleep(distance * lat_per_track * 1000 / bytes_per_track);
+        return 0;
+    }
+    if (p->seek_max_us == 0) {                        /* Solid state */
         return 0;
     }
 
-    usleep(distance * lat_per_track / bytes_per_track * 1000);
+    tracks = llabs(end / bytes_per_track - start / bytes_per_track);
+    seek_us = 0;
+    if (tracks != 0) {                                /* sqrt seek curve */
+        seek_us = p->seek_min_us + (p->seek_max_us - p->seek_min_us) * 
+                  isqrt(tracks * 10000 / (disk.track_num - 1)) / 100;
+    }
+    if (p->rpm != 0) {                                /* Rotational position */
+        period_us = 60L * 1000000 / p->rpm;
+        angle_us  = (now_us() + seek_us) % period_us;
+        target_us = (end % bytes_per_track) * period_us / bytes_per_track;
+        seek_us  += (target_us - angle_us + period_us) % period_us;
+    }
+    usleep(seek_us);
     return 0;
 }
+
+/* Per request cost: fixed controller/media latency plus transfer time */
+int emulate_transfer(int op, size_t size) {
+    struct ddriver_profile *p = PROFILE(disk);
+    long us;
+
+    if (disk.profile == DDRIVER_PROFILE_DEFAULT) {
+        usleep((op == DDRIVER_OP_WRITE ? disk.write_lat : disk.read_lat) * 1000);
+        return 0;
+    }
+    us = (op == DDRIVER_OP_WRITE) ? p->write_us : p->read_us;
+    if (p->mbps != 0) {
+        us += size / p->mbps;                         /* bytes / (MB/s) = us */
+    }
+    if (us > 0) {
+        usleep(us);
+    }
+    return 0;
+}
+int hist_bucket(uint64_t val) {
+    int bucket = val ? 63 - __builtin_clzll(val) : 0;
+    return bucket < DDRIVER_HIST_BUCKETS ? bucket : DDRIVER_HIST_BUCKETS - 1;
+}
+
+/* Fold one finished request into the statistics: size, latency since 
+   start_us, distance from the previous request and the region it hit */
+void account_io(int op, off_t offset, size_t size, long start_us) {
+    struct ddriver_state_ex *st = &disk.stats;
+    int region = offset * DDRIVER_HEAT_REGIONS / disk.layout_size;
+    int lat = hist_bucket(now_us() - start_us);
+
+    if (offset == last_end) {
+        INC_STAT(st->seq_cnt, 1);
+    }
+    else {
+        INC_STAT(st->rand_cnt, 1);
+        INC_STAT(st->seek_dist_hist[hist_bucket(llabs(offset - last_end) / 
+                                                disk.iounit_size)], 1);
+    }
+    last_end = offset + size;
+
+    if (op == DDRIVER_OP_WRITE) {
+        INC_STAT(st->write_cnt, 1);
+        INC_STAT(st->write_bytes, size);
+        INC_STAT(st->write_lat_hist[lat], 1);
+        INC_STAT(st->region_write[region], 1);
+    }
+    else {
+        INC_STAT(st->read_cnt, 1);
+        INC_STAT(st->read_bytes, size);
+        INC_STAT(st->read_lat_hist[lat], 1);
+        INC_STAT(st->region_read[region], 1);
+    }
+}
+/* Write to the media: head movement and transfer delay, then the image */
+int media_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset, size_t total) {
+    if (offset != last_pos) {
+        INC_SEEKCNT(disk);
+        emulate_rotate(fd, last_pos, offset);
+    }
+    emulate_transfer(DDRIVER_OP_WRITE, total);
+    if (pwritev(fd, iov, iovcnt, offset) != (ssize_t)total) {
+        user_panic("pwritev error: %s", strerror(errno));
+        return -EIO;
+    }
+    last_pos = offset + total;
+    return total;
+}
+
+int unit_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+/* Write one run of contiguous cached units and release them */
+int wcache_destage(int fd, struct iovec *iov, int cnt, uint64_t first) {
+    int i, ret;
+
+    ret = media_pwritev(fd, iov, cnt, first * disk.iounit_size, cnt * disk.iounit_size);
+    INC_STAT(disk.stats.wcache_destaged_bytes, cnt * disk.iounit_size);
+    for (i = 0; i < cnt; i++) {
+        free(wcache.unit[first + i]);
+        wcache.unit[first + i] = NULL;
+    }
+    return ret;
+}
+
+/* Destage every cached unit in one ascending sweep, contiguous units as one 
+   request. Caller holds wcache.lock */
+int wcache_drain_locked(int fd) {
+    struct iovec iov[CONFIG_IOV_MAX];
+    uint64_t i, u, first = 0;
+    int cnt = 0, ret = 0;
+
+    qsort(wcache.order, wcache.order_cnt, sizeof(uint64_t), unit_cmp);
+    for (i = 0; i < wcache.order_cnt; i++) {
+        u = wcache.order[i];
+        if (wcache.unit[u] == NULL || (i > 0 && wcache.order[i - 1] == u))
+            continue;                                 /* Invalidated or cached twice */
+        if (cnt > 0 && (u != first + cnt || cnt == CONFIG_IOV_MAX)) {
+            if (wcache_destage(fd, iov, cnt, first) < 0)
+                ret = -EIO;
+            cnt = 0;
+        }
+        if (cnt == 0)
+            first = u;
+        iov[cnt].iov_base = wcache.unit[u];
+        iov[cnt].iov_len = disk.iounit_size;
+        cnt++;
+    }
+    if (cnt > 0 && wcache_destage(fd, iov, cnt, first) < 0)
+        ret = -EIO;
+    wcache.dirty = 0;
+    wcache.order_cnt = 0;
+    return ret;
+}
+
+int wcache_drain(int fd) {
+    int ret;
+    pthread_mutex_lock(&wcache.lock);
+    ret = wcache_drain_locked(fd);
+    pthread_mutex_unlock(&wcache.lock);
+    return ret;
+}
+
+/* Forget cached units, unflushed data is gone. Returns the units dropped */
+uint64_t wcache_drop(void) {
+    uint64_t i, dropped;
+    pthread_mutex_lock(&wcache.lock);
+    dropped = wcache.dirty;
+    for (i = 0; i < wcache.order_cnt; i++) {
+        free(wcache.unit[wcache.order[i]]);
+        wcache.unit[wcache.order[i]] = NULL;
+    }
+    wcache.dirty = 0;
+    wcache.order_cnt = 0;
+    pthread_mutex_unlock(&wcache.lock);
+    return dropped;
+}
+
+/* The media now holds newer data for [offset, offset + size) */
+void wcache_invalidate(off_t offset, uint64_t size) {
+    uint64_t u;
+    if (wcache.capacity == 0)
+        return;
+    pthread_mutex_lock(&wcache.lock);
+    for (u = offset / disk.iounit_size; u < (offset + size) / disk.iounit_size; u++) {
+        if (wcache.unit[u] != NULL) {
+            free(wcache.unit[u]);
+            wcache.unit[u] = NULL;
+            wcache.dirty--;
+        }
+    }
+    pthread_mutex_unlock(&wcache.lock);
+}
+/* $DDRIVER_WCACHE or IOC_REQ_DEVICE_WCACHE, in bytes. 0 turns the cache off */
+int wcache_setup(int fd, uint64_t bytes) {
+    if (!IS_ADDR_ALIGN(bytes) || bytes > disk.layout_size) {
+        user_alert("write cache %lu must be a multiple of io unit, at most the disk", bytes);
+        return -EINVAL;
+    }
+    if (wcache_drain(fd) < 0)
+        return -EIO;
+    pthread_mutex_lock(&wcache.lock);
+    free(wcache.unit);
+    free(wcache.order);
+    wcache.unit = NULL;
+    wcache.order = NULL;
+    wcache.capacity = bytes / disk.iounit_size;
+    if (wcache.capacity != 0) {
+        wcache.unit = calloc(disk.layout_size / disk.iounit_size, sizeof(char *));
+        wcache.order = malloc(wcache.capacity * sizeof(uint64_t));
+        if (wcache.unit == NULL || wcache.order == NULL) {
+            wcache.capacity = 0;
+            pthread_mutex_unlock(&wcache.lock);
+            return -ENOMEM;
+        }
+    }
+    pthread_mutex_unlock(&wcache.lock);
+    return 0;
+}
+
+/* Acknowledge a write from the cache, destaging everything first when it 
+   would not fit. Writes larger than the whole cache go straight to the media */
+int wcache_absorb(int fd, const struct iovec *iov, int iovcnt, off_t offset, size_t total) {
+    uint64_t u = offset / disk.iounit_size;
+    size_t done;
+    int i, ret = 0;
+
+    if (total / disk.iounit_size > wcache.capacity) {
+        ret = media_pwritev(fd, iov, iovcnt, offset, total);
+        wcache_invalidate(offset, total);
+        return ret;
+    }
+    pthread_mutex_lock(&wcache.lock);
+    if (wcache.order_cnt + total / disk.iounit_size > wcache.capacity) {
+        ret = wcache_drain_locked(fd);
+    }
+    for (i = 0; i < iovcnt && ret == 0; i++) {
+        for (done = 0; done < iov[i].iov_len; done += disk.iounit_size, u++) {
+            if (wcache.unit[u] == NULL) {
+                wcache.unit[u] = malloc(disk.iounit_size);
+                wcache.order[wcache.order_cnt++] = u;
+                wcache.dirty++;
+            }
+            memcpy(wcache.unit[u], (char *)iov[i].iov_base + done, disk.iounit_size);
+        }
+    }
+    pthread_mutex_unlock(&wcache.lock);
+    if (ret < 0)
+        return ret;
+    INC_STAT(disk.stats.wcache_absorbed, 1);
+    return total;
+}
+
+/* Newer cached units over data just read from the media. Returns 1 when 
+   every unit of the range is cached, i.e. the media read can be skipped */
+int wcache_overlay(const struct iovec *iov, int iovcnt, off_t offset, int copy) {
+    uint64_t u = offset / disk.iounit_size;
+    size_t done;
+    int i, all = 1;
+
+    if (wcache.capacity == 0)
+        return 0;
+    pthread_mutex_lock(&wcache.lock);
+    for (i = 0; i < iovcnt; i++) {
+        for (done = 0; done < iov[i].iov_len; done += disk.iounit_size, u++) {
+            if (wcache.unit[u] == NULL)
+                all = 0;
+            else if (copy)
+                memcpy((char *)iov[i].iov_base + done, wcache.unit[u], disk.iounit_size);
+        }
+    }
+    pthread_mutex_unlock(&wcache.lock);
+    return all;
+}
+
+/* Drop the blocks of [offset, offset + size): the image stays sparse and the 
+   range reads back as zeros. Falls back to writing zeros without hole punching */
+int discard_range(int fd, off_t offset, uint64_t size) {
+    char buf[4096] = {'\0'};
+    uint64_t done, len;
+
+    wcache_invalidate(offset, size);
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size) == 0) {
+        return 0;
+    }
+    if (errno != EOPNOTSUPP) {
+        user_panic("fallocate error: %s", strerror(errno));
+        return -EIO;
+    }
+    for (done = 0; done < size; done += len) {
+        len = size - done < sizeof(buf) ? size - done : sizeof(buf);
+        if (pwrite(fd, buf, len, offset + done) != (ssize_t)len) {
+            user_panic("pwrite error: %s", strerror(errno));
+            return -EIO;
+        }
+    }
+    return 0;
+}
+/* By offset, then by submission order so requests on one offset keep order */
+int sched_cmp(const void *a, const void *b) {
+    const struct sched_ent *x = a, *y = b;
+    if (x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return x->idx - y->idx;
+}
+/* Each worker is one device channel: it serves a request through the 
+   positional path, so requests in flight overlap their latency */
+void *ring_worker(void *arg) {
+    struct ddriver_io *io;
+    struct iovec iov;
+    IGNORE_ARG(arg);
+
+    pthread_mutex_lock(&ring.lock);
+    while (1) {
+        while (ring.running && ring.sq_cnt == 0) {
+            pthread_cond_wait(&ring.sq_cond, &ring.lock);
+        }
+        if (ring.sq_cnt == 0) {
+            break;
+        }
+        io = ring.sq[ring.sq_head];
+        ring.sq_head = (ring.sq_head + 1) % CONFIG_RING_SZ;
+        ring.sq_cnt--;
+        pthread_mutex_unlock(&ring.lock);
+
+        if (io->opcode == DDRIVER_OP_READ) {
+            io->res = ddriver_pread(ring.fd, io->buf, io->size, io->offset);
+        }
+        else if (io->opcode == DDRIVER_OP_WRITE) {
+            iov.iov_base = io->buf;
+            iov.iov_len = io->size;
+            io->res = ddriver_pwritev2(ring.fd, &iov, 1, io->offset, io->flags);
+        }
+        else {
+            io->res = -EINVAL;
+        }
+
+        pthread_mutex_lock(&ring.lock);
+        ring.cq[(ring.cq_head + ring.cq_cnt) % CONFIG_RING_SZ] = io;
+        ring.cq_cnt++;
+        pthread_cond_broadcast(&ring.cq_cond);
+    }
+    pthread_mutex_unlock(&ring.lock);
+    return NULL;
+}
+
+int ring_start(int fd) {
+    int i;
+    ring.fd = fd;
+    ring.running = 1;
+    for (i = 0; i < CONFIG_WORKERS; i++) {
+        if (pthread_create(&ring.workers[i], NULL, ring_worker, NULL) != 0) {
+            user_panic("can't start ring worker %d", i);
+            ring.running = 0;
+            return -EAGAIN;
+        }
+    }
+    return 0;
+}
+
+void ring_stop(void) {
+    int i;
+    pthread_mutex_lock(&ring.lock);
+    if (!ring.running) {
+        pthread_mutex_unlock(&ring.lock);
+        return;
+    }
+    ring.running = 0;
+    pthread_cond_broadcast(&ring.sq_cond);
+    pthread_mutex_unlock(&ring.lock);
+    for (i = 0; i < CONFIG_WORKERS; i++) {
+        pthread_join(ring.workers[i], NULL);
+    }
+    ring.sq_head = ring.sq_cnt = 0;
+    ring.cq_head = ring.cq_cnt = 0;
+    ring.outstanding = 0;
+}
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
@@ -137,6 +685,15 @@ int ddriver_open(char *path) {
         return -1;
     }
 
+    ret = load_geometry();
+    if (ret < 0) {
+        return ret;
+    }
+    ret = load_profile();
+    if (ret < 0) {
+        return ret;
+    }
+
     if (access(device_path, F_OK) == 0) {
         fd = open(device_path, O_RDWR);
     }
@@ -147,8 +704,8 @@ int ddriver_open(char *path) {
         user_panic("can't open device: %d", fd);
         return fd;
     }
-    ret = posix_fallocate(fd, 0, CONFIG_DISK_SZ);
-    if (ret < 0) {
+    ret = posix_fallocate(fd, 0, disk.layout_size);
+    if (ret != 0) {
         user_panic("low space");
         return ret;
     }
@@ -159,6 +716,13 @@ int ddriver_open(char *path) {
         return -1;
     }
 
+    if (getenv("DDRIVER_WCACHE") != NULL) {
+        ret = wcache_setup(fd, strtoull(getenv("DDRIVER_WCACHE"), NULL, 0));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
     return fd;
 }
 /**
@@ -168,7 +732,20 @@ int ddriver_open(char *path) {
  * @return int 
  */
 int ddriver_close(int fd) {
-    return close(fd) && fclose(debugf);
+    int ret;
+    ring_stop();                                       /* Drain in-flight requests */
+    wcache_setup(fd, 0);                               /* Clean shutdown flushes the cache */
+    fprintf(debugf, "stats: read %lu (%lu bytes), write %lu (%lu bytes), seek %lu\n",
+            disk.stats.read_cnt, disk.stats.read_bytes, disk.stats.write_cnt, 
+            disk.stats.write_bytes, disk.stats.seek_cnt);  /* Counters so far, shown by ddriver -l */
+    if (disk.map_base != NULL) {
+        munmap(disk.map_base, disk.layout_size);
+        disk.map_base = NULL;
+    }
+    ret = close(fd);
+    if (fclose(debugf) != 0)                           /* Not skipped when close succeeds */
+        ret = -1;
+    return ret;
 }
 /**
  * @brief 磁盘头SEEK
@@ -183,8 +760,8 @@ int ddriver_seek(int fd, off_t offset, int whence){
     int cur = 0;
 
     if (!IS_ADDR_ALIGN(offset)) {
-        user_alert("offset %ld must be aligned to block size %d", 
-                      offset, CONFIG_BLOCK_SZ);
+        user_alert("offset %ld must be aligned to block size %ld", 
+                      offset, disk.iounit_size);
         return -EINVAL;
     }
 
@@ -207,15 +784,25 @@ int ddriver_seek(int fd, off_t offset, int whence){
  * @return int 
  */
 int ddriver_write(int fd, char *buf, size_t size){
+    long start = now_us();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
     int res = check_valid(size);
     if(res < 0)
         return res;
         
-    RW_DELAY(disk, write);
-    write(fd, buf, size);
+    if (wcache.capacity != 0) {
+        struct iovec iov = {.iov_base = buf, .iov_len = size};
+        if (wcache_absorb(fd, &iov, 1, pos, size) < 0)
+            return -EIO;
+        lseek(fd, pos + size, SEEK_SET);
+    }
+    else {
+        emulate_transfer(DDRIVER_OP_WRITE, size);
+        write(fd, buf, size);
+    }
 
-    INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    account_io(DDRIVER_OP_WRITE, pos, size, start);
+    return disk.iounit_size;
 }
 /**
  * @brief 
@@ -226,15 +813,407 @@ int ddriver_write(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_read(int fd, char *buf, size_t size){
+    long start = now_us();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
     int res = check_valid(size);
     if(res < 0)
         return res;
 
-    RW_DELAY(disk, read);
+    emulate_transfer(DDRIVER_OP_READ, size);
     read(fd, buf, size);
+    struct iovec iov = {.iov_base = buf, .iov_len = size};
+    wcache_overlay(&iov, 1, pos, 1);
+
+    account_io(DDRIVER_OP_READ, pos, size, start);
+    return disk.iounit_size;
+}
+/**
+ * @brief 磁盘向量写入，从当前磁盘头开始连续写入多个IO单位，
+ * 整个请求只计一次写延迟和一次写计数
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @return int 写入的字节数
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt){
+    long start = now_us();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    size_t total;
+    int res = check_valid_iov(iov, iovcnt, &total);
+    if(res < 0)
+        return res;
+
+    if (wcache.capacity != 0) {
+        if (wcache_absorb(fd, iov, iovcnt, pos, total) < 0)
+            return -EIO;
+        lseek(fd, pos + total, SEEK_SET);
+    }
+    else {
+        emulate_transfer(DDRIVER_OP_WRITE, total);
+        if (writev(fd, iov, iovcnt) != (ssize_t)total) {
+            user_panic("writev error: %s", strerror(errno));
+            return -EIO;
+        }
+    }
+
+    account_io(DDRIVER_OP_WRITE, pos, total, start);
+    return total;
+}
+/**
+ * @brief 磁盘向量读出，从当前磁盘头开始连续读出多个IO单位，
+ * 整个请求只计一次读延迟和一次读计数
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @return int 读出的字节数
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt){
+    long start = now_us();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    size_t total;
+    int res = check_valid_iov(iov, iovcnt, &total);
+    if(res < 0)
+        return res;
+
+    emulate_transfer(DDRIVER_OP_READ, total);
+    if (readv(fd, iov, iovcnt) != (ssize_t)total) {
+        user_panic("readv error: %s", strerror(errno));
+        return -EIO;
+    }
+    wcache_overlay(iov, iovcnt, pos, 1);
+
+    account_io(DDRIVER_OP_READ, pos, total, start);
+    return total;
+}
+/**
+ * @brief 从指定偏移处定位写入，不经过也不改变共享的文件位置，
+ * 寻道延迟按调用线程自己的上次位置计算，可在多线程中并发使用
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @param offset 需和IO单位对齐
+ * @return int 写入的字节数
+ */
+int ddriver_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset){
+    return ddriver_pwritev2(fd, iov, iovcnt, offset, 0);
+}
+/**
+ * @brief 带标志的定位写入。打开写缓存时写入只进缓存即返回，
+ * 带DDRIVER_RWF_FUA时直接写到介质，返回时已持久
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @param offset 需和IO单位对齐
+ * @param flags DDRIVER_RWF_FUA
+ * @return int 写入的字节数
+ */
+int ddriver_pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags){
+    long start = now_us();
+    size_t total;
+    int res = check_valid_iov(iov, iovcnt, &total);
+    if(res < 0)
+        return res;
+    res = check_valid_range(offset, total);
+    if(res < 0)
+        return res;
+
+    if (wcache.capacity != 0 && !(flags & DDRIVER_RWF_FUA)) {
+        res = wcache_absorb(fd, iov, iovcnt, offset, total);
+    }
+    else {
+        res = media_pwritev(fd, iov, iovcnt, offset, total);
+        wcache_invalidate(offset, total);            /* Cached copies are older now */
+    }
+    if (res < 0)
+        return res;
+
+    account_io(DDRIVER_OP_WRITE, offset, total, start);
+    return total;
+}
+/**
+ * @brief 从指定偏移处定位读出，不经过也不改变共享的文件位置，
+ * 寻道延迟按调用线程自己的上次位置计算，可在多线程中并发使用
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @param offset 需和IO单位对齐
+ * @return int 读出的字节数
+ */
+int ddriver_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset){
+    long start = now_us();
+    size_t total;
+    int res = check_valid_iov(iov, iovcnt, &total);
+    if(res < 0)
+        return res;
+    res = check_valid_range(offset, total);
+    if(res < 0)
+        return res;
+
+    if (wcache_overlay(iov, iovcnt, offset, 0)) {   /* Served by the cache */
+        wcache_overlay(iov, iovcnt, offset, 1);
+        INC_STAT(disk.stats.wcache_read_hits, 1);
+        account_io(DDRIVER_OP_READ, offset, total, start);
+        return total;
+    }
+    if (offset != last_pos) {
+        INC_SEEKCNT(disk);
+        emulate_rotate(fd, last_pos, offset);
+    }
+    emulate_transfer(DDRIVER_OP_READ, total);
+    if (preadv(fd, iov, iovcnt, offset) != (ssize_t)total) {
+        user_panic("preadv error: %s", strerror(errno));
+        return -EIO;
+    }
+    last_pos = offset + total;
+    wcache_overlay(iov, iovcnt, offset, 1);
 
-    INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    account_io(DDRIVER_OP_READ, offset, total, start);
+    return total;
+}
+/**
+ * @brief 定位写入连续的若干IO单位
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size IO单位的整数倍
+ * @param offset 需和IO单位对齐
+ * @return int 写入的字节数
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset){
+    struct iovec iov = {.iov_base = buf, .iov_len = size};
+    return ddriver_pwritev(fd, &iov, 1, offset);
+}
+/**
+ * @brief 定位读出连续的若干IO单位
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size IO单位的整数倍
+ * @param offset 需和IO单位对齐
+ * @return int 读出的字节数
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset){
+    struct iovec iov = {.iov_base = buf, .iov_len = size};
+    return ddriver_preadv(fd, &iov, 1, offset);
+}
+/**
+ * @brief 零拷贝访问：返回镜像中对齐区域的指针，镜像只在第一次调用时映射一次，
+ * 指针在ddriver_close前一直有效。带DDRIVER_MAP_READ时计一次读请求，
+ * 只写映射不计读，修改需要调用ddriver_commit提交
+ * 
+ * @param fd 
+ * @param offset 需和IO单位对齐
+ * @param size IO单位的整数倍
+ * @param prot DDRIVER_MAP_READ | DDRIVER_MAP_WRITE
+ * @return char* 失败返回NULL
+ */
+char *ddriver_map(int fd, off_t offset, size_t size, int prot){
+    long start = now_us();
+    char *base;
+    if (size == 0 || !IS_ADDR_ALIGN(size) || check_valid_range(offset, size) < 0)
+        return NULL;
+
+    pthread_mutex_lock(&ring.lock);
+    if (disk.map_base == NULL) {
+        base = mmap(NULL, disk.layout_size, PROT_READ | PROT_WRITE, 
+                    MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            pthread_mutex_unlock(&ring.lock);
+            user_panic("mmap error: %s", strerror(errno));
+            return NULL;
+        }
+        disk.map_base = base;
+    }
+    pthread_mutex_unlock(&ring.lock);
+    if (wcache.dirty != 0 && wcache_drain(fd) < 0)    /* Mapped access bypasses the cache */
+        return NULL;
+
+    if (prot & DDRIVER_MAP_READ) {
+        if (offset != last_pos) {
+            INC_SEEKCNT(disk);
+            emulate_rotate(fd, last_pos, offset);
+        }
+        emulate_transfer(DDRIVER_OP_READ, size);
+        last_pos = offset + size;
+        account_io(DDRIVER_OP_READ, offset, size, start);
+    }
+    return disk.map_base + offset;
+}
+/**
+ * @brief 提交通过ddriver_map修改的区域，计一次写请求
+ * 
+ * @param fd 
+ * @param offset 需和IO单位对齐
+ * @param size IO单位的整数倍
+ * @param flags DDRIVER_COMMIT_SYNC 等待落盘(msync MS_SYNC)，否则异步回写
+ * @return int 提交的字节数
+ */
+int ddriver_commit(int fd, off_t offset, size_t size, int flags){
+    off_t page_sz = sysconf(_SC_PAGESIZE);
+    off_t page_start;
+    long start = now_us();
+    int res;
+    if (disk.map_base == NULL)
+        return -EINVAL;
+    if (size == 0 || !IS_ADDR_ALIGN(size))
+        return -EIO;
+    res = check_valid_range(offset, size);
+    if(res < 0)
+        return res;
+
+    if (offset != last_pos) {
+        INC_SEEKCNT(disk);
+        emulate_rotate(fd, last_pos, offset);
+    }
+    emulate_transfer(DDRIVER_OP_WRITE, size);
+    page_start = (offset / page_sz) * page_sz;        /* msync needs page alignment */
+    if (msync(disk.map_base + page_start, offset + size - page_start, 
+              (flags & DDRIVER_COMMIT_SYNC) ? MS_SYNC : MS_ASYNC) < 0) {
+        user_panic("msync error: %s", strerror(errno));
+        return -EIO;
+    }
+    last_pos = offset + size;
+
+    account_io(DDRIVER_OP_WRITE, offset, size, start);
+    return size;
+}
+/**
+ * @brief 异步提交一批读写请求，立即返回。请求结束后可通过ddriver_reap取回，
+ * 取回前ios指向的描述符和数据Buf必须保持有效
+ * 
+ * @param fd 
+ * @param ios 请求描述符数组
+ * @param nr 请求个数
+ * @return int 实际入队的请求个数，环满时可能小于nr
+ */
+int ddriver_submit(int fd, struct ddriver_io *ios, int nr){
+    int i, ret = 0;
+
+    pthread_mutex_lock(&ring.lock);
+    if (!ring.running) {
+        ret = ring_start(fd);
+        if (ret < 0) {
+            pthread_mutex_unlock(&ring.lock);
+            return ret;
+        }
+    }
+    for (i = 0; i < nr && ring.outstanding < CONFIG_RING_SZ; i++) {
+        ios[i].res = 0;
+        ring.sq[(ring.sq_head + ring.sq_cnt) % CONFIG_RING_SZ] = &ios[i];
+        ring.sq_cnt++;
+        ring.outstanding++;
+    }
+    pthread_cond_broadcast(&ring.sq_cond);
+    pthread_mutex_unlock(&ring.lock);
+    return i;
+}
+/**
+ * @brief 取回已完成的请求，每个请求的结果在其res中
+ * 
+ * @param fd 
+ * @param ios 返回已完成请求的描述符指针
+ * @param min_nr 至少等待完成的个数，0表示只轮询不阻塞
+ * @param max_nr 最多取回的个数
+ * @return int 取回的请求个数
+ */
+int ddriver_reap(int fd, struct ddriver_io **ios, int min_nr, int max_nr){
+    int n = 0;
+    IGNORE_ARG(fd);
+
+    pthread_mutex_lock(&ring.lock);
+    if (min_nr > ring.outstanding) {
+        min_nr = ring.outstanding;
+    }
+    while (ring.cq_cnt < min_nr) {
+        pthread_cond_wait(&ring.cq_cond, &ring.lock);
+    }
+    while (n < max_nr && ring.cq_cnt > 0) {
+        ios[n++] = ring.cq[ring.cq_head];
+        ring.cq_head = (ring.cq_head + 1) % CONFIG_RING_SZ;
+        ring.cq_cnt--;
+        ring.outstanding--;
+    }
+    pthread_mutex_unlock(&ring.lock);
+    return n;
+}
+/**
+ * @brief 电梯调度：一批请求按偏移排序，从当前磁头位置开始向上扫描，
+ * 到末尾后回到最低偏移继续(C-SCAN)，偏移相接的同类请求合并成一次向量请求。
+ * 同一偏移上的请求保持提交顺序，除此之外请求不应相互重叠
+ * 
+ * @param fd 
+ * @param ios 请求描述符数组，结果填入各自的res
+ * @param nr 请求个数
+ * @return int 成功完成的请求个数
+ */
+int ddriver_dispatch(int fd, struct ddriver_io *ios, int nr){
+    struct sched_ent *ents;
+    struct ddriver_io *io;
+    struct iovec iov[CONFIG_IOV_MAX];
+    off_t head = last_pos, run_ofs;
+    uint64_t dist_fifo = 0, dist_sweep = 0;
+    size_t total;
+    int first, k, cnt, i, ret, runs = 0, done = 0;
+
+    if (nr <= 0)
+        return 0;
+    ents = malloc(nr * sizeof(struct sched_ent));
+    if (ents == NULL)
+        return -ENOMEM;
+    for (i = 0; i < nr; i++) {
+        ents[i].offset = ios[i].offset;
+        ents[i].idx = i;
+        dist_fifo += llabs(ios[i].offset - head);
+        head = ios[i].offset + ios[i].size;
+    }
+    qsort(ents, nr, sizeof(struct sched_ent), sched_cmp);
+    for (first = 0; first < nr && ents[first].offset < last_pos; first++);
+
+    head = last_pos;
+    for (k = 0; k < nr; k += cnt) {
+        io = &ios[ents[(first + k) % nr].idx];
+        run_ofs = io->offset;
+        total = 0;
+        for (cnt = 0; k + cnt < nr && cnt < CONFIG_IOV_MAX; cnt++) {
+            i = ents[(first + k + cnt) % nr].idx;
+            if (cnt > 0 && (ios[i].opcode != io->opcode || ios[i].flags != io->flags ||
+                            ios[i].offset != run_ofs + (off_t)total))
+                break;                                /* Not contiguous, start a new run */
+            iov[cnt].iov_base = ios[i].buf;
+            iov[cnt].iov_len = ios[i].size;
+            total += ios[i].size;
+        }
+        dist_sweep += llabs(run_ofs - head);
+        head = run_ofs + total;
+
+        if (io->opcode == DDRIVER_OP_WRITE)
+            ret = ddriver_pwritev2(fd, iov, cnt, run_ofs, io->flags);
+        else
+            ret = ddriver_preadv(fd, iov, cnt, run_ofs);
+        for (i = 0; i < cnt; i++) {
+            io = &ios[ents[(first + k + i) % nr].idx];
+            io->res = (ret == (int)total) ? (int)io->size : (ret < 0 ? ret : -EIO);
+            done += (ret == (int)total);
+        }
+        runs++;
+    }
+
+    INC_STAT(disk.stats.sched_batches, 1);
+    INC_STAT(disk.stats.sched_requests, nr);
+    INC_STAT(disk.stats.sched_merged, nr - runs);
+    INC_STAT(disk.stats.sched_dist_fifo, dist_fifo);
+    INC_STAT(disk.stats.sched_dist_sweep, dist_sweep);
+    disk.stats.sched_order_len = nr < DDRIVER_SCHED_TRACE ? nr : DDRIVER_SCHED_TRACE;
+    for (k = 0; k < (int)disk.stats.sched_order_len; k++) {
+        disk.stats.sched_order[k] = ents[(first + k) % nr].idx;
+    }
+    free(ents);
+    return done;
 }
 /**
  * @brief 
@@ -246,31 +1225,56 @@ int ddriver_read(int fd, char *buf, size_t size){
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
     struct ddriver_state state;
+    struct ddriver_range range;
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        memcpy(arg, &disk.layout_size, sizeof(int));
+        memcpy(arg, &disk.layout_size, sizeof(uint64_t));
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = disk.stats.read_cnt;
+        state.write_cnt = disk.stats.write_cnt;
+        state.seek_cnt = disk.stats.seek_cnt;
         memcpy(arg, &state, sizeof(struct ddriver_state));
         break;
+    case IOC_REQ_DEVICE_STATE_EX:                     /* Device State, 64-bit */
+        memcpy(arg, &disk.stats, sizeof(struct ddriver_state_ex));
+        break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
         lseek(fd, 0, SEEK_SET);
-        char buf[4096] = {'\0'};
-        for (size_t i = 0; i < CONFIG_DISK_SZ; i += 4096)
-        {
-            write(fd, buf, 4096);
-        }
-        lseek(fd, 0, SEEK_SET);
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        wcache_drop();
+        if (discard_range(fd, 0, disk.layout_size) < 0)
+            return -EIO;
+        memset(&disk.stats, 0, sizeof(struct ddriver_state_ex));
+        last_pos = last_end = 0;
         break;
     case IOC_REQ_DEVICE_IO_SZ:
-        memcpy(arg, &disk.iounit_size, sizeof(int));
+        memcpy(arg, &disk.iounit_size, sizeof(uint64_t));
+        break;
+    case IOC_REQ_DEVICE_DISCARD:                      /* Discard Range */
+        memcpy(&range, arg, sizeof(struct ddriver_range));
+        if (range.size == 0 || !IS_ADDR_ALIGN(range.size) ||
+            check_valid_range(range.offset, range.size) < 0)
+            return -EINVAL;
+        if (discard_range(fd, range.offset, range.size) < 0)
+            return -EIO;
+        INC_STAT(disk.stats.discard_cnt, 1);
+        INC_STAT(disk.stats.discard_bytes, range.size);
+        break;
+    case IOC_REQ_FLUSH:                               /* Drain Write Cache */
+        if (wcache_drain(fd) < 0)
+            return -EIO;
+        INC_STAT(disk.stats.wcache_flushes, 1);
+        break;
+    case IOC_REQ_DEVICE_CRASH:                        /* Power Loss, Cache Lost */
+        INC_STAT(disk.stats.wcache_lost_bytes, wcache_drop() * disk.iounit_size);
+        break;
+    case IOC_REQ_DEVICE_WCACHE:                       /* Resize Write Cache */
+        return wcache_setup(fd, *(uint64_t *)arg);
+    case IOC_REQ_DEVICE_PROFILE:                      /* Switch latency model */
+        if (*(int *)arg < 0 || *(int *)arg >= DDRIVER_PROFILE_NUM)
+            return -EINVAL;
+        disk.profile = *(int *)arg;
         break;
     default:
         break;
@@ -2,6 +2,7 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>   
+#include <stdint.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +14,62 @@ struct ddriver_state
     int seek_cnt;
 };
 
-#define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
+#define DDRIVER_HIST_BUCKETS    24      /* Bucket i holds [2^i, 2^(i+1)), last one holds the rest */
+#define DDRIVER_HEAT_REGIONS    64      /* Device split into equal regions */
+#define DDRIVER_SCHED_TRACE     64      /* Dispatched order kept for the last batch */
+
+struct ddriver_state_ex
+{
+    uint64_t write_cnt;
+    uint64_t read_cnt;
+    uint64_t seek_cnt;
+    uint64_t write_bytes;
+    uint64_t read_bytes;
+    uint64_t seq_cnt;                                       /* Requests starting where the previous ended */
+    uint64_t rand_cnt;
+    uint64_t read_lat_hist[DDRIVER_HIST_BUCKETS];           /* us */
+    uint64_t write_lat_hist[DDRIVER_HIST_BUCKETS];          /* us */
+    uint64_t seek_dist_hist[DDRIVER_HIST_BUCKETS];          /* IO units jumped by random requests */
+    uint64_t region_read[DDRIVER_HEAT_REGIONS];
+    uint64_t region_write[DDRIVER_HEAT_REGIONS];
+    uint64_t discard_cnt;
+    uint64_t discard_bytes;
+    uint64_t sched_batches;                                 /* Batches through the elevator */
+    uint64_t sched_requests;
+    uint64_t sched_merged;                                  /* Requests merged into a neighbour */
+    uint64_t sched_dist_fifo;                               /* Head travel in bytes in submit order */
+    uint64_t sched_dist_sweep;                              /* Head travel in bytes in dispatched order */
+    uint32_t sched_order_len;
+    uint32_t sched_order[DDRIVER_SCHED_TRACE];              /* Last batch, i-th dispatched is ios[sched_order[i]] */
+    uint64_t wcache_absorbed;                               /* Writes acknowledged from the cache */
+    uint64_t wcache_read_hits;                              /* Reads served entirely by the cache */
+    uint64_t wcache_destaged_bytes;
+    uint64_t wcache_flushes;
+    uint64_t wcache_lost_bytes;                             /* Unflushed bytes dropped by a crash */
+};
+
+struct ddriver_range
+{
+    uint64_t offset;                                        /* Aligned to IO unit */
+    uint64_t size;                                          /* Multiple of IO unit */
+};
+
+#define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, uint64_t)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
-#define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, uint64_t)
+#define IOC_REQ_DEVICE_PROFILE  _IOW(IOC_MAGIC, 4, int)
+#define IOC_REQ_DEVICE_STATE_EX _IOR(IOC_MAGIC, 5, struct ddriver_state_ex)
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 6, struct ddriver_range)
+#define IOC_REQ_FLUSH           _IO(IOC_MAGIC, 7)
+#define IOC_REQ_DEVICE_CRASH    _IO(IOC_MAGIC, 8)
+#define IOC_REQ_DEVICE_WCACHE   _IOW(IOC_MAGIC, 9, uint64_t)
+
+#define DDRIVER_PROFILE_DEFAULT 0
+#define DDRIVER_PROFILE_HDD     1
+#define DDRIVER_PROFILE_SSD     2
+#define DDRIVER_PROFILE_NVME    3
+#define DDRIVER_PROFILE_NONE    4
+#define DDRIVER_PROFILE_NUM     5
 
 #endif
\ No newline at end of file
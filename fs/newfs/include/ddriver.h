@@ -3,6 +3,29 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
+
+#define DDRIVER_OP_READ     0
+#define DDRIVER_OP_WRITE    1
+
+#define DDRIVER_MAP_READ    0x1         /* 映射后要读取，计一次读请求 */
+#define DDRIVER_MAP_WRITE   0x2         /* 映射后要修改，需ddriver_commit */
+#define DDRIVER_COMMIT_SYNC 0x1         /* 提交时等待落盘 */
+#define DDRIVER_RWF_FUA     0x1         /* 写穿设备写缓存，返回时已持久 */
+
+/**
+ * @brief 异步请求描述符
+ */
+struct ddriver_io
+{
+    int     opcode;             /* DDRIVER_OP_READ / DDRIVER_OP_WRITE */
+    char   *buf;                /* 数据Buf，完成前需保持有效 */
+    size_t  size;               /* 设备IO单位的整数倍 */
+    off_t   offset;             /* 和设备IO单位对齐 */
+    void   *user_data;          /* 调用者自用 */
+    int     res;                /* 完成时填入，传输的字节数或-errno */
+    int     flags;              /* 写请求的DDRIVER_RWF_*，不用时置0 */
+};
 
 /**
  * @brief 打开ddriver设备
@@ -42,6 +65,137 @@ int ddriver_write(int fd, char *buf, size_t size);
  */
 int ddriver_read(int fd, char *buf, size_t size);
 
+/**
+ * @brief 向量写入，从当前磁盘头开始连续写入多个IO单位，整个请求只计一次延迟
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要写入的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 向量读出，从当前磁盘头开始连续读出多个IO单位，整个请求只计一次延迟
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要读出的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 定位向量写入，不经过共享的磁盘头，可在多线程中并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要写入的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+/**
+ * @brief 带标志的定位向量写入。设备打开写缓存时，普通写入进入缓存即返回，
+ * 需IOC_REQ_FLUSH才能保证持久；带DDRIVER_RWF_FUA的写入直接落盘
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要写入的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @param flags DDRIVER_RWF_*
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags);
+
+/**
+ * @brief 定位向量读出，不经过共享的磁盘头，可在多线程中并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要读出的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @param offset 读出位置，注意要和设备IO单位对齐
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+/**
+ * @brief 定位写入连续的若干IO单位
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，注意是设备IO单位的整数倍
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 定位读出连续的若干IO单位
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，注意是设备IO单位的整数倍
+ * @param offset 读出位置，注意要和设备IO单位对齐
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 异步提交一批读写请求，立即返回，多个请求由设备并行处理，延迟相互重叠
+ * 
+ * @param fd ddriver设备handler
+ * @param ios 请求描述符数组，请求被取回前需保持有效
+ * @param nr 请求个数
+ * @return int 实际入队的请求个数，队列满时可能小于nr
+ */
+int ddriver_submit(int fd, struct ddriver_io *ios, int nr);
+
+/**
+ * @brief 取回已完成的异步请求
+ * 
+ * @param fd ddriver设备handler
+ * @param ios 返回已完成请求的描述符指针
+ * @param min_nr 至少等待完成的个数，0表示只轮询不阻塞
+ * @param max_nr 最多取回的个数
+ * @return int 取回的请求个数
+ */
+int ddriver_reap(int fd, struct ddriver_io **ios, int min_nr, int max_nr);
+
+/**
+ * @brief 同步下发一批读写请求：按偏移排序，从当前磁头位置起单向扫描一遍，
+ * 偏移相接的同类请求合并为一次请求。除偏移相同者按提交顺序外，请求不应相互重叠
+ * 
+ * @param fd ddriver设备handler
+ * @param ios 请求描述符数组，结果填入各自的res
+ * @param nr 请求个数
+ * @return int 成功完成的请求个数
+ */
+int ddriver_dispatch(int fd, struct ddriver_io *ios, int nr);
+
+/**
+ * @brief 零拷贝访问，返回设备镜像中对齐区域的指针，镜像只映射一次，指针在关闭设备前有效
+ * 
+ * @param fd ddriver设备handler
+ * @param offset 区域起始位置，注意要和设备IO单位对齐
+ * @param size 区域大小，注意是设备IO单位的整数倍
+ * @param prot DDRIVER_MAP_READ | DDRIVER_MAP_WRITE
+ * @return char* 区域指针，失败返回NULL
+ */
+char *ddriver_map(int fd, off_t offset, size_t size, int prot);
+
+/**
+ * @brief 提交通过ddriver_map修改的区域
+ * 
+ * @param fd ddriver设备handler
+ * @param offset 区域起始位置，注意要和设备IO单位对齐
+ * @param size 区域大小，注意是设备IO单位的整数倍
+ * @param flags DDRIVER_COMMIT_SYNC等待落盘，0异步回写
+ * @return int 提交的字节数，小于0失败
+ */
+int ddriver_commit(int fd, off_t offset, size_t size, int flags);
+
 /**
  * @brief ddriver IO控制
  * 
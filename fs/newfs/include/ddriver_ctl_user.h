@@ -2,6 +2,7 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>   
+#include <stdint.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +14,62 @@ struct ddriver_state
     int seek_cnt;
 };
 
-#define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)                     /* 请求查看设备大小 */
+#define DDRIVER_HIST_BUCKETS    24      /* 直方图按2的幂分桶: 桶i统计[2^i, 2^(i+1))，末桶含更大值 */
+#define DDRIVER_HEAT_REGIONS    64      /* 热度图把设备等分成的区域数 */
+#define DDRIVER_SCHED_TRACE     64      /* 记录最近一批调度顺序的长度 */
+
+struct ddriver_state_ex
+{
+    uint64_t write_cnt;
+    uint64_t read_cnt;
+    uint64_t seek_cnt;
+    uint64_t write_bytes;
+    uint64_t read_bytes;
+    uint64_t seq_cnt;                                       /* 紧接上一请求结尾的请求数 */
+    uint64_t rand_cnt;                                      /* 其余请求数 */
+    uint64_t read_lat_hist[DDRIVER_HIST_BUCKETS];           /* 读延迟分布，单位us */
+    uint64_t write_lat_hist[DDRIVER_HIST_BUCKETS];          /* 写延迟分布，单位us */
+    uint64_t seek_dist_hist[DDRIVER_HIST_BUCKETS];          /* 随机请求的跳跃距离分布，单位IO块 */
+    uint64_t region_read[DDRIVER_HEAT_REGIONS];             /* 每个区域的读请求数 */
+    uint64_t region_write[DDRIVER_HEAT_REGIONS];            /* 每个区域的写请求数 */
+    uint64_t discard_cnt;
+    uint64_t discard_bytes;
+    uint64_t sched_batches;                                 /* 经过电梯调度的批次数 */
+    uint64_t sched_requests;
+    uint64_t sched_merged;                                  /* 与相邻请求合并的请求数 */
+    uint64_t sched_dist_fifo;                               /* 按提交顺序服务时磁头移动的字节数 */
+    uint64_t sched_dist_sweep;                              /* 按调度顺序服务时磁头移动的字节数 */
+    uint32_t sched_order_len;
+    uint32_t sched_order[DDRIVER_SCHED_TRACE];              /* 最近一批的调度顺序，第i个下发的是ios[sched_order[i]] */
+    uint64_t wcache_absorbed;                               /* 只进写缓存即完成的写请求数 */
+    uint64_t wcache_read_hits;                              /* 全部由写缓存满足的读请求数 */
+    uint64_t wcache_destaged_bytes;                         /* 从写缓存落盘的字节数 */
+    uint64_t wcache_flushes;
+    uint64_t wcache_lost_bytes;                             /* 模拟掉电时丢失的未落盘字节数 */
+};
+
+struct ddriver_range
+{
+    uint64_t offset;                                        /* 需和IO单位对齐 */
+    uint64_t size;                                          /* IO单位的整数倍 */
+};
+
+#define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, uint64_t)                /* 请求查看设备大小 */
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)    /* 请求设备状态，返回 ddriver_state */
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)                           /* 请求重置设备 */
-#define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)                     /* 请求设备IO大小 */
+#define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, uint64_t)                /* 请求设备IO大小 */
+#define IOC_REQ_DEVICE_PROFILE  _IOW(IOC_MAGIC, 4, int)                     /* 请求切换延迟模型，参数为 DDRIVER_PROFILE_* */
+#define IOC_REQ_DEVICE_STATE_EX _IOR(IOC_MAGIC, 5, struct ddriver_state_ex) /* 请求扩展设备状态，返回 ddriver_state_ex */
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 6, struct ddriver_range)    /* 请求丢弃一段区域，之后读出为0 */
+#define IOC_REQ_FLUSH           _IO(IOC_MAGIC, 7)                           /* 请求把写缓存落盘，返回后此前完成的写都已持久 */
+#define IOC_REQ_DEVICE_CRASH    _IO(IOC_MAGIC, 8)                           /* 模拟掉电，丢弃写缓存中未落盘的数据 */
+#define IOC_REQ_DEVICE_WCACHE   _IOW(IOC_MAGIC, 9, uint64_t)                /* 请求设置写缓存大小(字节)，0为直写 */
+
+#define DDRIVER_PROFILE_DEFAULT 0                                           /* 原有的固定延迟模型 */
+#define DDRIVER_PROFILE_HDD     1                                           /* 7200转机械盘：寻道曲线+旋转等待 */
+#define DDRIVER_PROFILE_SSD     2                                           /* SATA SSD：无寻道 */
+#define DDRIVER_PROFILE_NVME    3                                           /* NVMe SSD */
+#define DDRIVER_PROFILE_NONE    4                                           /* 无延迟 */
+#define DDRIVER_PROFILE_NUM     5
 
 #endif
\ No newline at end of file
@@ -9,6 +9,9 @@
 #include "string.h"
 #include "fuse.h"
 #include <stddef.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
 #include "ddriver.h"
 #include "errno.h"
 #include "types.h"
@@ -24,17 +27,129 @@
 *******************************************************************************/
 char* 				 lxhfs_get_fname(const char* path);
 int 			     lxhfs_calc_lvl(const char * path);
-int 			     lxhfs_driver_read(int offset, uint8_t *out_content, int size);
-int 			     lxhfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			     lxhfs_driver_read(uint64_t offset, uint8_t *out_content, int size);
+int 			     lxhfs_driver_write(uint64_t offset, uint8_t *in_content, int size);
+int 			     lxhfs_driver_batch(struct ddriver_io *ios, int nr);
+void 			     lxhfs_plug_overlay(uint64_t offset, uint8_t *buf, int size);
+void 			     lxhfs_plug_add(uint64_t offset, uint8_t *buf, int size);
+void 			     lxhfs_plug();
+int 			     lxhfs_unplug();
+int 			     lxhfs_buf_writeout(uint64_t offset, uint8_t *buf, int size);
+int 			     lxhfs_buf_init(int blks);
+void 			     lxhfs_buf_destroy();
+struct lxhfs_buf*    lxhfs_buf_lookup(uint64_t blkno);
+void 			     lxhfs_buf_unhash(struct lxhfs_buf* buf);
+struct lxhfs_buf*    lxhfs_buf_get(uint64_t blkno);
+int 			     lxhfs_buf_read(uint64_t offset, uint8_t *out_content, int size);
+boolean 		     lxhfs_buf_cached(uint64_t offset, int size);
+int 			     lxhfs_buf_fill(uint64_t offset, uint8_t *content, int size);
+int 			     lxhfs_buf_write(uint64_t offset, uint8_t *in_content, int size);
+void 			     lxhfs_buf_drop(uint64_t blkno);
+int 			     lxhfs_buf_flush(int max_blks);
+long 			     lxhfs_now_ms();
+boolean 		     lxhfs_inode_listed(struct lxhfs_inode* inode);
+void 			     lxhfs_mark_dirty(struct lxhfs_inode* inode, flag16 flags, int blk);
+void 			     lxhfs_mark_clean(struct lxhfs_inode* inode);
+void 			     lxhfs_mark_data_clean(struct lxhfs_inode* inode, int blk);
+int 			     lxhfs_dir_probe(struct lxhfs_inode* inode, const char* fname);
+int 			     lxhfs_dir_load(struct lxhfs_inode* inode);
 int 			     lxhfs_alloc_dentry(struct lxhfs_inode* inode, struct lxhfs_dentry* dentry);
 struct lxhfs_inode*  lxhfs_alloc_inode(struct lxhfs_dentry * dentry);
+int 			     lxhfs_alloc_run(int goal, int len, int* got);
+int 			     lxhfs_alloc_data(int goal);
+void 			     lxhfs_free_data(int dno);
+int 			     lxhfs_resize_data(struct lxhfs_inode* inode, int blks);
+int 			     lxhfs_discard_flush();
+void 			     lxhfs_data_touch(struct lxhfs_inode* inode);
+void 			     lxhfs_data_unlist(struct lxhfs_inode* inode);
+void 			     lxhfs_data_put(struct lxhfs_inode* inode, int blk);
+int 			     lxhfs_data_load(struct lxhfs_inode* inode, int from, int to);
+void 			     lxhfs_data_evict();
+int 			     lxhfs_data_copy(struct lxhfs_inode* inode, uint64_t offset, uint8_t *buf, int size, boolean is_write);
+int 			     lxhfs_data_truncate(struct lxhfs_inode* inode, int size);
+int 			     lxhfs_data_charge(struct lxhfs_inode* inode, int size);
+int 			     lxhfs_drop_inode(struct lxhfs_inode* inode);
+int 			     lxhfs_drop_dentry(struct lxhfs_inode* inode, struct lxhfs_dentry* dentry);
 int 				 lxhfs_sync_inode(struct lxhfs_inode * inode);
+int 				 lxhfs_sync_dirty(int max_blks);
+int 				 lxhfs_sync_super();
+int 				 lxhfs_writeback(int max_blks);
+void* 				 lxhfs_writeback_thread(void* arg);
 struct lxhfs_inode*  lxhfs_read_inode(struct lxhfs_dentry * dentry, int ino);
 struct lxhfs_dentry* lxhfs_get_dentry(struct lxhfs_inode * inode, int dir);
 struct lxhfs_dentry* lxhfs_lookup(const char * path, boolean* is_find, boolean* is_root);
 int 				 lxhfs_mount(struct custom_options options);
 int 				 lxhfs_umount();
 /******************************************************************************
+* SECTION: lxhfs_journal.c
+*******************************************************************************/
+uint32_t 			 lxhfs_journal_csum(uint8_t *data, int size, uint32_t csum);
+int 				 lxhfs_journal_io(int blk, uint8_t *buf, int blks, boolean is_write, int flags);
+int 				 lxhfs_journal_reset(uint64_t seq);
+int 				 lxhfs_journal_find(uint64_t blkno);
+void 				 lxhfs_journal_remove(int i);
+int 				 lxhfs_journal_write(uint64_t offset, uint8_t *in_content, int size);
+void 				 lxhfs_journal_overlay(uint64_t offset, uint8_t *out_content, int size);
+void 				 lxhfs_journal_revoke(uint64_t blkno);
+int 				 lxhfs_journal_checkpoint();
+int 				 lxhfs_journal_commit();
+int 				 lxhfs_journal_replay(uint64_t journal_offset, int journal_blks);
+void 				 lxhfs_journal_destroy();
+/******************************************************************************
+* SECTION: lxhfs_extent.c
+*******************************************************************************/
+void 				 lxhfs_extent_init(struct lxhfs_inode* inode);
+int 				 lxhfs_extent_grow(struct lxhfs_inode* inode, int blks);
+void 				 lxhfs_extent_destroy(struct lxhfs_inode* inode);
+int 				 lxhfs_extent_pack(struct lxhfs_inode* inode, struct lxhfs_inode_d* inode_d);
+int 				 lxhfs_extent_map(struct lxhfs_inode* inode, struct lxhfs_extent_d* ext);
+int 				 lxhfs_extent_unpack(struct lxhfs_inode* inode, struct lxhfs_inode_d* inode_d);
+void 				 lxhfs_extent_free(struct lxhfs_inode* inode);
+/******************************************************************************
+* SECTION: lxhfs_bitmap.c
+*******************************************************************************/
+int 				 lxhfs_bitmap_init(struct lxhfs_bitmap* bm, uint8_t* map, int nbits);
+int 				 lxhfs_bitmap_track(struct lxhfs_bitmap* bm, int sz_blk);
+void 				 lxhfs_bitmap_destroy(struct lxhfs_bitmap* bm);
+int 				 lxhfs_bitmap_alloc(struct lxhfs_bitmap* bm);
+int 				 lxhfs_bitmap_alloc_goal(struct lxhfs_bitmap* bm, int goal);
+int 				 lxhfs_bitmap_count(struct lxhfs_bitmap* bm, int from, int to);
+void 				 lxhfs_bitmap_set(struct lxhfs_bitmap* bm, int bit);
+void 				 lxhfs_bitmap_clear(struct lxhfs_bitmap* bm, int bit);
+boolean 			 lxhfs_bitmap_test(struct lxhfs_bitmap* bm, int bit);
+int 				 lxhfs_bitmap_find(struct lxhfs_bitmap* bm, int goal, int len);
+int 				 lxhfs_bitmap_alloc_run(struct lxhfs_bitmap* bm, int goal, int len, int* got);
+int 				 lxhfs_bitmap_extend(struct lxhfs_bitmap* bm, int bit, int len);
+int 				 lxhfs_bitmap_reserve(struct lxhfs_bitmap* bm, int bit, int len);
+void 				 lxhfs_bitmap_claim(struct lxhfs_bitmap* bm, int bit, int n);
+void 				 lxhfs_bitmap_unreserve(struct lxhfs_bitmap* bm, int bit, int n);
+/******************************************************************************
+* SECTION: lxhfs_group.c
+*******************************************************************************/
+int 				 lxhfs_group_init();
+void 				 lxhfs_group_touch(int g);
+int 				 lxhfs_group_sync();
+void 				 lxhfs_group_destroy();
+int 				 lxhfs_group_find(struct lxhfs_dentry* dentry);
+int 				 lxhfs_group_goal(struct lxhfs_inode* inode, int blk);
+/******************************************************************************
+* SECTION: lxhfs_mkfs.c
+*******************************************************************************/
+int 				 lxhfs_mkfs_layout(struct lxhfs_super_d* super_d, uint64_t sz_disk, int sz_blk, int inode_ratio, int group_blks);
+int 				 lxhfs_mkfs(int fd, struct lxhfs_super_d* super_d);
+/******************************************************************************
+* SECTION: lxhfs_dir.c
+*******************************************************************************/
+uint32_t 			 lxhfs_dir_hash(const char* fname);
+int 				 lxhfs_dir_add(struct lxhfs_inode* inode, struct lxhfs_dentry* dentry);
+int 				 lxhfs_dir_remove(struct lxhfs_inode* inode, struct lxhfs_dentry* dentry);
+struct lxhfs_dentry* lxhfs_dir_find(struct lxhfs_inode* inode, const char* fname);
+int 				 lxhfs_dir_fill(struct lxhfs_inode* inode, struct lxhfs_dentry_d* dentry_d, int cnt);
+void 				 lxhfs_dir_destroy(struct lxhfs_inode* inode);
+void 				 lxhfs_dentry_to_disk(struct lxhfs_dentry_d* dentry_d, struct lxhfs_dentry* dentry);
+uint8_t* 			 lxhfs_dx_build(struct lxhfs_inode* inode, int sz_blk, int* blks);
+int 				 lxhfs_dx_next(uint8_t* blk, uint32_t hash);
+/******************************************************************************
 * SECTION: lxhfs.c
 *******************************************************************************/
 void* 			   lxhfs_init(struct fuse_conn_info *);
@@ -15,10 +15,12 @@ typedef enum lxhfs_file_type {
 *******************************************************************************/
 #define TRUE                    1
 #define FALSE                   0
+#define UINT64_BITS             64
 #define UINT32_BITS             32
 #define UINT8_BITS              8
 
-#define LXHFS_MAGIC_NUM           0x20020510 
+#define LXHFS_MAGIC_NUM           0x20020511                    /* 区段、紧凑inode、日志区和块组的磁盘格式 */
+#define LXHFS_MAGIC_NUM_V1        0x20020510                    /* 最初的磁盘格式，不再支持，挂载时拒绝 */
 #define LXHFS_SUPER_OFS           0
 #define LXHFS_ROOT_INO            0
 
@@ -34,17 +36,45 @@ typedef enum lxhfs_file_type {
 #define LXHFS_ERROR_UNSUPPORTED   ENXIO
 #define LXHFS_ERROR_IO            EIO     /* Error Input/Output */
 #define LXHFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define LXHFS_ERROR_NOTDIR        ENOTDIR
+#define LXHFS_ERROR_NOTEMPTY      ENOTEMPTY
+#define LXHFS_ERROR_FBIG          EFBIG
 
 #define LXHFS_MAX_FILE_NAME       128
+#define LXHFS_MAX_FILE_SZ         INT_MAX                       /* inode中的文件大小是int */
 #define LXHFS_INODE_PER_FILE      1
-#define LXHFS_DATA_PER_FILE       16
+#define LXHFS_INODE_SZ            256                           /* 磁盘inode的大小，一个块中紧密存放多个 */
+#define LXHFS_EXT_ROOT            4                             /* inode中内嵌的区段数，放不下时改存区段块号 */
 #define LXHFS_DEFAULT_PERM        0777
+#define LXHFS_DNO_NONE            (-1)                          /* 未分配数据块 */
 
 #define LXHFS_IOC_MAGIC           'S'
 #define LXHFS_IOC_SEEK            _IO(LXHFS_IOC_MAGIC, 0)
 
 #define LXHFS_FLAG_BUF_DIRTY      0x1
 #define LXHFS_FLAG_BUF_OCCUPY     0x2   
+#define LXHFS_FLAG_INODE_DIRTY    0x1                           /* inode本身(大小、数据块号、目录项数)需写回 */
+#define LXHFS_FLAG_DIR_DIRTY      0x2                           /* 目录项有增删，目录块需重写 */
+#define LXHFS_INODE_INLINE        0x1                           /* 文件数据或目录项内嵌在inode的空余部分 */
+#define LXHFS_INODE_INDEXED       0x2                           /* 目录块带哈希索引，第0块为索引根 */
+#define LXHFS_DX_MAGIC            0x58444C58                    /* 索引块幻数 */
+#define LXHFS_DIR_HASH_MIN        16                            /* 目录哈希表的初始桶数 */
+#define LXHFS_DEFAULT_CACHE_BLKS  256                           /* 默认缓存块数，--cache=0关闭缓存 */
+#define LXHFS_DEFAULT_WB_AGE      5000                          /* 脏数据最长停留时间(ms)，--wb_age=0关闭后台刷写 */
+#define LXHFS_DEFAULT_WB_BYTES    (64 * 1024)                   /* 脏数据超过该字节数即刷写 */
+#define LXHFS_DEFAULT_WB_INODES   32                            /* 脏inode超过该数目即刷写 */
+#define LXHFS_DEFAULT_WB_IO       32                            /* 每轮最多写回的块数 */
+#define LXHFS_DEFAULT_DATA_BLKS   512                           /* 常驻内存的文件数据块上限，--data_cache=0不限 */
+#define LXHFS_DEFAULT_INODE_RATIO 16384                         /* 格式化时每多少字节磁盘空间配一个inode */
+#define LXHFS_MKFS_CHUNK_BLKS     256                           /* 格式化时单次顺序写出的块数 */
+#define LXHFS_DEFAULT_GROUP_BLKS  512                           /* 每个块组的块数(inode片+数据片)，不超过一个位图块能描述的块数 */
+#define LXHFS_RSV_SLOTS           8                             /* 同时持有预留窗口的文件数，超出时收回最早的窗口 */
+#define LXHFS_RSV_MAX_BLKS        128                           /* 预留窗口的块数上限，窗口按文件已有大小翻倍 */
+#define LXHFS_JOURNAL_BLKS        64                            /* 日志区块数，第0块为日志超级块 */
+#define LXHFS_JNL_MAGIC           0x4A4E4C58                    /* 日志块幻数 */
+#define LXHFS_JNL_SUPER           0                             /* 日志超级块，记录日志中第一个事务的序号 */
+#define LXHFS_JNL_DESC            1                             /* 描述块，其后紧跟nr个元数据块的镜像 */
+#define LXHFS_JNL_COMMIT          2                             /* 提交块，写下即事务生效 */
 
 /******************************************************************************
 * SECTION: Macro Function
@@ -57,10 +87,29 @@ typedef enum lxhfs_file_type {
 #define LXHFS_ROUND_DOWN(value, round)    (value % round == 0 ? value : (value / round) * round)
 #define LXHFS_ROUND_UP(value, round)      (value % round == 0 ? value : (value / round + 1) * round)
 
-#define LXHFS_BLKS_SZ(blks)               (blks * LXHFS_BLK_SZ())
+#define LXHFS_BLKS_SZ(blks)               ((blks) * LXHFS_BLK_SZ())
 #define LXHFS_ASSIGN_FNAME(plxhfs_dentry, _fname)   memcpy(plxhfs_dentry->fname, _fname, strlen(_fname))
-#define LXHFS_INO_OFS(ino)                (lxhfs_super.inode_offset + ino * LXHFS_BLK_SZ())    /*求ino对应inode偏移位置*/
-#define LXHFS_DATA_OFS(dno)               (lxhfs_super.data_offset + dno * LXHFS_BLK_SZ())     /*求dno对应data偏移位置*/
+#define LXHFS_INO_SZ()                    (lxhfs_super.sz_inode)
+#define LXHFS_INO_PER_BLK()               (LXHFS_BLK_SZ() / LXHFS_INO_SZ())                                 /*一个块存放的inode数*/
+#define LXHFS_INO_GROUP(ino)              ((int)(ino) / lxhfs_super.group_inodes)                           /*ino所在的块组*/
+#define LXHFS_DATA_GROUP(dno)             ((int)(dno) / lxhfs_super.group_data)                             /*dno所在的块组*/
+#define LXHFS_INO_OFS(ino)                (lxhfs_super.inode_offset + (uint64_t)LXHFS_INO_GROUP(ino) * lxhfs_super.group_stride + \
+                                           (uint64_t)((ino) % lxhfs_super.group_inodes) * LXHFS_INO_SZ())  /*块组的inode片中第ino%group_inodes个，64位*/
+#define LXHFS_DATA_OFS(dno)               (lxhfs_super.data_offset + (uint64_t)LXHFS_DATA_GROUP(dno) * lxhfs_super.group_stride + \
+                                           (uint64_t)((dno) % lxhfs_super.group_data) * LXHFS_BLK_SZ())    /*块组的数据片中第dno%group_data块，64位*/
+#define LXHFS_DENTRY_PER_BLK()            ((int)(LXHFS_BLK_SZ() / sizeof(struct lxhfs_dentry_d)))           /*一个数据块可存放的目录项数*/
+#define LXHFS_DX_PER_BLK(sz_blk)          ((int)(((sz_blk) - sizeof(struct lxhfs_dx_head)) / sizeof(struct lxhfs_dx_entry))) /*一个索引块可存放的索引项数*/
+
+#define LXHFS_BUF_BLKNO(offset)           ((offset) / LXHFS_BLK_SZ())                                       /*偏移所在的块号*/
+
+#define LXHFS_JNL_OFS(blk)                (lxhfs_super.journal_offset + (uint64_t)(blk) * LXHFS_BLK_SZ())  /*日志区第blk块的偏移*/
+#define LXHFS_JNL_DESC_CAP()              ((int)((LXHFS_BLK_SZ() - sizeof(struct lxhfs_jnl_d)) / sizeof(uint64_t))) /*描述块可记录的块号数*/
+
+#define LXHFS_DATA_IS_DIRTY(pinode, blk) ((pinode)->data_dirty[(blk) / UINT32_BITS] & (1U << ((blk) % UINT32_BITS))) /*第blk个数据块是否需写回*/
+#define LXHFS_INLINE_SZ()                 ((int)(LXHFS_INO_SZ() - sizeof(struct lxhfs_inode_d)))           /*inode中可内嵌的字节数*/
+#define LXHFS_INLINE_DENTRYS()            ((int)(LXHFS_INLINE_SZ() / sizeof(struct lxhfs_dentry_d)))        /*inode中可内嵌的目录项数*/
+#define LXHFS_EXT_PER_BLK()               ((int)(LXHFS_BLK_SZ() / sizeof(struct lxhfs_extent_d)))          /*一个区段块可存放的区段数*/
+#define LXHFS_EXT_MAX()                   (LXHFS_EXT_ROOT * LXHFS_EXT_PER_BLK())                            /*一个文件最多的区段数*/
 
 #define LXHFS_IS_DIR(pinode)              (pinode->dentry->ftype == LXHFS_DIR)
 #define LXHFS_IS_REG(pinode)              (pinode->dentry->ftype == LXHFS_REG_FILE)
@@ -71,9 +120,47 @@ struct lxhfs_super;
 struct lxhfs_inode;
 struct lxhfs_dentry;
 
+struct lxhfs_bitmap {
+    uint64_t*          words;                   /* 位图本身，小端下第i位即第i/8字节的第i%8位，与磁盘格式一致 */
+    uint64_t*          full;                    /* 汇总层：第w位表示words[w]已全部占用 */
+    int                nbits;                   /* 有效位数，最后一个字中多出的位视为已占用 */
+    int                nwords;
+    int                nfull;                   /* 汇总层的字数 */
+    int                cursor;                  /* next-fit：下一次从这个字开始找 */
+    int                nfree;                   /* 可分配的位数，不含已预留的位 */
+    uint64_t*          rsv;                     /* 只在内存中的预留位，分配时与words一起视为不可用 */
+    int                nrsv;                    /* 预留位数 */
+    int                seg;                     /* 连续分配不跨过seg的整数倍，0为不限 */
+    uint8_t*           dirty;                   /* 第i个位图块有修改，写回时只写这些块；NULL为不记录 */
+    int                blk_words;               /* 一个位图块中的字数 */
+};
+
 struct custom_options {
 	const char*        device;
 	boolean            show_help;
+	boolean            use_mmap;                /* --mmap: 通过映射的设备镜像零拷贝读写 */
+	int                cache_blks;              /* --cache=N: 块缓存的块数，0为不缓存 */
+	int                wb_age;                  /* --wb_age=ms: 后台刷写阈值，0为不启动刷写线程 */
+	int                wb_bytes;                /* --wb_bytes=N */
+	int                wb_inodes;               /* --wb_inodes=N */
+	int                wb_io;                   /* --wb_io=N: 每轮写回的块数上限 */
+	int                data_blks;               /* --data_cache=N: 常驻内存的文件数据块上限，0为不限 */
+	boolean            show_stats;              /* --stats: 卸载时打印缓存、刷写、日志等统计 */
+};
+
+struct lxhfs_jblk {
+    uint64_t           blkno;                   /* 元数据块的块号 */
+    uint8_t*           data;                    /* 最新内容 */
+    uint8_t*           ckpt;                    /* 最近一次提交的内容，检查点时写回原位，未提交过为NULL */
+    boolean            dirty;                   /* 在运行中的事务里有修改 */
+};
+
+struct lxhfs_buf {
+    uint64_t           blkno;                   /* 缓存的设备块号 */
+    uint8_t*           data;
+    flag16             flags;                   /* LXHFS_FLAG_BUF_OCCUPY / LXHFS_FLAG_BUF_DIRTY */
+    boolean            ref;                     /* CLOCK引用位，命中时置位，扫过时清除 */
+    struct lxhfs_buf*  hnext;                   /* 同一哈希桶中的下一个 */
 };
 
 struct lxhfs_super {
@@ -81,26 +168,95 @@ struct lxhfs_super {
     int                driver_fd;
 
     int                sz_io;                   /*驱动IO的大小*/
-    int                sz_disk;                 /*磁盘大小*/
+    uint64_t           sz_disk;                 /*磁盘大小*/
     int                sz_blk;                  /*EXT2文件系统一个块大小*/
     int                sz_usage;
 
     int                max_ino;                 /*inode的数目，即最多支持的文件数*/
     uint8_t*           map_inode;               /*inode位图*/
+    struct lxhfs_bitmap bm_inode;               /*inode位图的分配器*/
     int                map_inode_blks;          /*inode位图所占的数据块*/
-    int                map_inode_offset;        /*inode位图的偏移,即起始地址*/
+    uint64_t           map_inode_offset;        /*inode位图的偏移,即起始地址*/
 
     int                max_data;               /*data索引的数目*/
     uint8_t*           map_data;               /*data位图*/
+    struct lxhfs_bitmap bm_data;               /*data位图的分配器*/
     int                map_data_blks;          /*数据位图所占的数据块*/
-    int                map_data_offset;        /*数据位图的偏移,即起始地址*/
+    uint64_t           map_data_offset;        /*数据位图的偏移,即起始地址*/
+    uint8_t*           map_discard;            /*已释放、待下发discard的数据块位图，每轮写回提交后合并成区间下发*/
+    boolean            has_discard;            /*map_discard中可能有待下发的块*/
+
+    uint64_t           inode_offset;            /*第0个块组inode片的偏移,即起始地址*/
+    int                sz_inode;                /*磁盘inode的大小*/
+    int                inode_blks;              /*每个块组inode片所占的块数*/
+    uint64_t           data_offset;             /*第0个块组数据片的偏移,即起始地址*/
 
-    int                inode_offset;            /*inode块区的偏移,即起始地址*/
-    int                data_offset;             /*数据块的偏移,即起始地址*/
+    struct lxhfs_group_d* groups;               /*块组描述符表*/
+    int                group_cnt;               /*块组数*/
+    int                group_inodes;            /*每个块组的inode数*/
+    int                group_data;              /*每个块组的数据块数，最后一个块组可能不满*/
+    uint64_t           group_stride;            /*相邻块组的间距(字节)*/
+    uint64_t           group_desc_offset;       /*块组描述符表的偏移*/
+    int                group_desc_blks;         /*块组描述符表所占的块数*/
+    uint8_t*           group_dirty;             /*第i个描述符块有修改*/
+    struct lxhfs_inode* rsv_owner[LXHFS_RSV_SLOTS]; /*持有预留窗口的inode*/
+    int                rsv_next;                /*下一个被收回的预留槽*/
 
     boolean            is_mounted;
+    boolean            is_dirty;                /*超级块或位图有修改，需写回*/
 
     struct lxhfs_dentry* root_dentry;             /*根目录*/
+
+    boolean            is_plugged;              /*写请求先排队，unplug时交给驱动电梯调度一次下发*/
+    struct ddriver_io* plug_ios;                /*排队的写请求，每个占有自己的Buf*/
+    int                plug_cnt;
+    int                plug_cap;
+
+    struct lxhfs_buf*  bufs;                    /* 块缓存，写回式，按CLOCK淘汰 */
+    int                buf_cnt;
+    struct lxhfs_buf** buf_hash;                /* 按块号索引，桶数为2的幂 */
+    int                buf_hash_sz;
+    int                buf_hand;                /* CLOCK指针 */
+    uint64_t           buf_hit;
+    uint64_t           buf_miss;
+    uint64_t           buf_evict;
+    uint64_t           buf_writeback;           /* 写回设备的脏块数 */
+    int                buf_dirty;               /* 缓存中的脏块数 */
+
+    pthread_mutex_t    lock;                    /* FUSE回调与后台刷写线程互斥 */
+    pthread_cond_t     wb_cond;                 /* 唤醒刷写线程 */
+    pthread_t          wb_thread;
+    boolean            wb_running;
+    int                wb_age;                  /* 后台刷写阈值，见custom_options */
+    int                wb_bytes;
+    int                wb_inodes;
+    int                wb_io;
+    struct lxhfs_inode* dirty_head;             /* 脏inode链表，按变脏先后排列，表头最旧 */
+    struct lxhfs_inode* dirty_tail;
+    int                dirty_inodes;
+    uint64_t           dirty_bytes;             /* 脏inode待写回的字节数(估计) */
+    uint64_t           wb_rounds;               /* 后台刷写的轮数 */
+
+    int                data_limit;              /* 常驻内存的文件数据块上限，0为不限 */
+    int                data_resident;           /* 常驻内存的文件数据块数 */
+    struct lxhfs_inode* res_head;               /* 有常驻数据块的inode，按最近访问排列，表头最久未用 */
+    struct lxhfs_inode* res_tail;
+    uint64_t           data_faults;             /* 按需读入的数据块数 */
+    uint64_t           data_evicts;             /* 淘汰的数据块数 */
+    int                pend_blks;               /* 已写入、写回时才分配的数据块数，写入时从空闲块中扣除 */
+
+    uint64_t           journal_offset;          /* 日志区，journal_blks为0时不记日志 */
+    int                journal_blks;
+    uint64_t           jnl_seq;                 /* 下一个事务的序号 */
+    int                jnl_head;                /* 日志区中下一个空闲块 */
+    struct lxhfs_jblk* jnl_blks;                /* 上次检查点以来记过日志的元数据块 */
+    int                jnl_cnt;
+    int                jnl_cap;
+    uint64_t*          jnl_revoke;              /* 运行中的事务里被释放的块，重放时不再写回 */
+    int                jnl_revoke_cnt;
+    uint64_t           jnl_commits;
+    uint64_t           jnl_logged;              /* 写入日志的块镜像数 */
+    uint64_t           jnl_checkpoints;
 };
 
 struct lxhfs_inode {
@@ -111,8 +267,29 @@ struct lxhfs_inode {
     LXHFS_FILE_TYPE    ftype;                         /* 文件类型 */
     struct lxhfs_dentry* dentry;                      /* 指向该inode的dentry */
     struct lxhfs_dentry* dentrys;                     /* 所有目录项 */
-    uint8_t*           data[LXHFS_DATA_PER_FILE];     /* 如果是FILE文件，数据块指针 */
-    int                dno[LXHFS_DATA_PER_FILE];      /* inode指向文件的各个数据块在数据位图中的下标 */    
+    uint8_t**          data;                          /* 如果是FILE文件，数据块指针，首次访问时才读入，NULL为不在内存 */
+    int*               dno;                           /* 由区段展开的逐块映射，第i个数据块在数据位图中的下标 */
+    int                blk_cap;                       /* data/dno的长度，UINT32_BITS的倍数 */
+    int                ext_dno[LXHFS_EXT_ROOT];       /* 区段块的数据块号，区段都在inode中时为LXHFS_DNO_NONE */
+    flag16             flags;                         /* LXHFS_FLAG_INODE_DIRTY / LXHFS_FLAG_DIR_DIRTY */
+    uint32_t*          data_dirty;                    /* 第i位为1表示第i个数据块需写回 */
+    int                data_dirty_cnt;                /* 需写回的数据块数 */
+    int                dirty_bytes;                   /* 计入lxhfs_super.dirty_bytes的部分 */
+    long               dirtied_at;                    /* 变脏的时间(ms) */
+    struct lxhfs_inode* dirty_prev;                   /* 脏inode链表 */
+    struct lxhfs_inode* dirty_next;
+    int                res_cnt;                       /* 常驻内存的数据块数 */
+    struct lxhfs_inode* res_prev;                     /* 常驻数据块的LRU链表 */
+    struct lxhfs_inode* res_next;
+    int                rsv_slot;                      /* 预留窗口在lxhfs_super.rsv_owner中的槽，-1为没有 */
+    int                rsv_start;                     /* 预留窗口：紧接最后一块的[rsv_start, rsv_start + rsv_len) */
+    int                rsv_len;
+    int                pend_blks;                     /* 文件大小以内尚未分配的数据块数，计入lxhfs_super.pend_blks */
+    struct lxhfs_dentry** dir_hash;                   /* 目录项按文件名哈希分桶，桶数为2的幂，同桶以hash_next相连 */
+    int                dir_hash_sz;
+    int                dir_hash_cnt;                  /* 已读入内存的目录项数，目录只读入一部分时小于dir_cnt */
+    boolean            dir_partial;                   /* 带索引的目录只按需读入了部分叶块，增删前要全部读入 */
+    int                dx_blks;                       /* 带索引时目录占用的块数，0为不带索引 */
 };
 
 struct lxhfs_dentry {
@@ -124,6 +301,8 @@ struct lxhfs_dentry {
     uint32_t     ino;                                 /* 指向的ino号 */
     struct lxhfs_inode*  inode;                       /* 指向inode */
     int     valid;                                    /* 该目录项是否有效 */  
+    uint32_t     hash;                                /* 文件名哈希 */
+    struct lxhfs_dentry* hash_next;                   /* 父目录哈希表中同一个桶的下一项 */
 };
 
 static inline struct lxhfs_dentry* new_dentry(char * fname, LXHFS_FILE_TYPE ftype) {
@@ -148,13 +327,40 @@ struct lxhfs_super_d {
 
     uint32_t           max_ino;                 /*inode的数目，即最多支持的文件数*/
     int                map_inode_blks;          /*inode位图所占的数据块*/
-    int                map_inode_offset;        /*inode位图的偏移*/
+    uint64_t           map_inode_offset;        /*inode位图的偏移*/
 
+    uint32_t           max_data;                /*数据块的数目*/
     int                map_data_blks;           /*数据位图所占的数据块*/
-    int                map_data_offset;         /*数据位图的偏移*/
+    uint64_t           map_data_offset;         /*数据位图的偏移*/
+
+    uint64_t           inode_offset;            /*inode块区的偏移*/
+    uint64_t           data_offset;             /*数据块区的偏移*/
+
+    uint64_t           journal_offset;          /*日志区的偏移*/
+    int                journal_blks;            /*日志区所占的数据块*/
+
+    int                sz_inode;                /*磁盘inode的大小*/
+    int                inode_blks;              /*每个块组inode片所占的块数*/
+    int                sz_blk;                  /*逻辑块大小*/
+
+    uint64_t           group_desc_offset;       /*块组描述符表的偏移*/
+    int                group_desc_blks;         /*块组描述符表所占的块数*/
+    int                group_cnt;               /*块组数*/
+    int                group_inodes;            /*每个块组的inode数，inode片占group_inodes / (sz_blk / sz_inode)块*/
+    int                group_data;              /*每个块组的数据块数，块组依次紧挨着放在日志区之后*/
+};
+
+struct lxhfs_group_d {
+    uint32_t           free_inodes;                   /* 空闲inode数 */
+    uint32_t           free_data;                     /* 空闲数据块数 */
+    uint32_t           dirs;                          /* 目录数，Orlov分散目录时参考 */
+    uint32_t           pad;
+};
 
-    int                inode_offset;            /*inode块区的偏移*/
-    int                data_offset;             /*数据块区的偏移*/
+struct lxhfs_extent_d {
+    uint32_t           lblk;                          /* 区段的第一个文件内块号 */
+    uint32_t           start;                         /* 对应的第一个数据块号 */
+    uint32_t           len;                           /* 连续的块数 */
 };
 
 struct lxhfs_inode_d {
@@ -163,7 +369,11 @@ struct lxhfs_inode_d {
     int                size;                          /* 文件已占用空间 */
     int                dir_cnt;                       /* 如果是目录类型文件，下面有几个目录项 */
     LXHFS_FILE_TYPE    ftype;                         /* 文件类型 */
-    int                dno[LXHFS_DATA_PER_FILE];      /* inode指向文件的各个数据块在数据位图中的下标 */    
+    uint16_t           ext_cnt;                       /* 区段总数 */
+    uint16_t           ext_depth;                     /* 0: ext[]即区段; 1: ext[i]为区段块，start为其块号，len为其中的区段数 */
+    uint32_t           flags;                         /* LXHFS_INODE_INLINE: 数据紧跟在本结构之后，直到LXHFS_INO_SZ()，不占数据块；
+                                                         LXHFS_INODE_INDEXED: 目录块为索引块加按哈希排序的叶块 */
+    struct lxhfs_extent_d ext[LXHFS_EXT_ROOT];        /* 区段树的根 */
 };
 
 struct lxhfs_dentry_d {
@@ -173,4 +383,23 @@ struct lxhfs_dentry_d {
     uint32_t     ino;                                 /* 指向的ino号 */
     int     valid;                                    /* 该目录项是否有效 */  
 };
+struct lxhfs_dx_head {
+    uint32_t           magic;                         /* LXHFS_DX_MAGIC */
+    uint16_t           levels;                        /* 其下还有几层索引块，0表示索引项直接指向叶块 */
+    uint16_t           count;                         /* 索引项数 */
+};
+struct lxhfs_dx_entry {
+    uint32_t           hash;                          /* 子块中最小的文件名哈希，叶块之间不拆开同一个哈希值 */
+    uint32_t           blk;                           /* 子块在目录中的块号 */
+};
+struct lxhfs_jnl_d {
+    uint32_t           magic;                         /* LXHFS_JNL_MAGIC */
+    uint32_t           type;                          /* LXHFS_JNL_SUPER / DESC / COMMIT */
+    uint64_t           seq;                           /* 事务序号 */
+    uint32_t           nr;                            /* 事务中的块镜像数 */
+    uint32_t           nr_revoke;                     /* 描述块: blkno[nr...]为被释放的块 */
+    uint32_t           csum;                          /* 提交块: 块镜像的校验和 */
+    uint32_t           pad;
+    uint64_t           blkno[];                       /* 描述块: 各镜像的原位块号 */
+};
 #endif /* _TYPES_H_ */
\ No newline at end of file
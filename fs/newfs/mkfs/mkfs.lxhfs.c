@@ -0,0 +1,117 @@
+#include "lxhfs.h"
+
+/******************************************************************************
+* SECTION: 宏定义
+*******************************************************************************/
+#define OPTION(t, p)        { t, offsetof(struct mkfs_options, p), 1 }
+
+struct mkfs_options {
+	const char*        device;
+	const char*        layout;                  /* --layout=path: 写出与新布局一致的fs.layout */
+	int                sz_blk;                  /* --block_size=B: 逻辑块大小 */
+	int                inode_ratio;             /* --inode_ratio=B: 每多少字节配一个inode */
+	int                group_blks;              /* --group_blks=N: 每个块组的块数 */
+};
+
+/******************************************************************************
+* SECTION: 全局变量
+*******************************************************************************/
+static struct mkfs_options mkfs_options;
+
+static const struct fuse_opt option_spec[] = {
+	OPTION("--device=%s", device),
+	OPTION("--layout=%s", layout),
+	OPTION("--block_size=%d", sz_blk),
+	OPTION("--inode_ratio=%d", inode_ratio),
+	OPTION("--group_blks=%d", group_blks),
+	FUSE_OPT_END
+};
+
+/******************************************************************************
+* SECTION: 布局文件
+*******************************************************************************/
+/**
+ * @brief 按checkbm的格式写出布局，块数都取自超级块
+ *
+ * @param path
+ * @param super_d
+ * @return int
+ */
+static int mkfs_write_layout(const char* path, struct lxhfs_super_d* super_d) {
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL) {
+		return -LXHFS_ERROR_IO;
+	}
+	fprintf(fp, "# Layout File\n");
+	fprintf(fp, "# 由mkfs.lxhfs生成。Group Desc为块组描述符表，日志区之后是%d个块组，\n", super_d->group_cnt);
+	fprintf(fp, "# 每个块组依次是Inode(%d)和DATA(%d)，最后一个块组的DATA可能不满，\n",
+			super_d->inode_blks, super_d->group_data);
+	fprintf(fp, "# 各块组的位图合在一起放在Inode Map和DATA Map中\n\n");
+	fprintf(fp, "| BSIZE = %d B |\n", super_d->sz_blk);
+	fprintf(fp, "| Super(1) | Inode Map(%d) | DATA Map(%d) | Group Desc(%d) | Journal(%d) | Groups(*)\n",
+			super_d->map_inode_blks, super_d->map_data_blks,
+			super_d->group_desc_blks, super_d->journal_blks);
+	fclose(fp);
+	return LXHFS_ERROR_NONE;
+}
+
+/******************************************************************************
+* SECTION: 入口
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	struct lxhfs_super_d super_d;
+	uint64_t sz_disk, sz_io;
+	int fd, ret;
+
+	mkfs_options.device = strdup("TODO: 这里填写你的ddriver设备路径");
+	mkfs_options.layout = NULL;
+	mkfs_options.sz_blk = 0;
+	mkfs_options.inode_ratio = LXHFS_DEFAULT_INODE_RATIO;
+	mkfs_options.group_blks = LXHFS_DEFAULT_GROUP_BLKS;
+
+	if (fuse_opt_parse(&args, &mkfs_options, option_spec, NULL) == -1)
+		return -1;
+
+	fd = ddriver_open((char *)mkfs_options.device);
+	if (fd < 0) {
+		fprintf(stderr, "mkfs.lxhfs: cannot open %s\n", mkfs_options.device);
+		return -1;
+	}
+	ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &sz_disk);
+	ddriver_ioctl(fd, IOC_REQ_DEVICE_IO_SZ, &sz_io);
+	if (mkfs_options.sz_blk == 0) {
+		mkfs_options.sz_blk = 2 * (int)sz_io;			/* 与挂载时的默认块大小一致 */
+	}
+	if (mkfs_options.sz_blk % (int)sz_io != 0) {
+		fprintf(stderr, "mkfs.lxhfs: block size must be a multiple of %d\n", (int)sz_io);
+		ddriver_close(fd);
+		return -1;
+	}
+
+	ret = lxhfs_mkfs_layout(&super_d, sz_disk, mkfs_options.sz_blk, mkfs_options.inode_ratio,
+							mkfs_options.group_blks);
+	if (ret == LXHFS_ERROR_NONE)
+		ret = lxhfs_mkfs(fd, &super_d);
+	ddriver_close(fd);
+	if (ret != LXHFS_ERROR_NONE) {
+		fprintf(stderr, "mkfs.lxhfs: format failed (%d)\n", ret);
+		return -1;
+	}
+
+	printf("block size %d B, %u inodes, %u data blocks\n",
+		   super_d.sz_blk, super_d.max_ino, super_d.max_data);
+	printf("inode map %d, data map %d, group desc %d, journal %d blocks\n",
+		   super_d.map_inode_blks, super_d.map_data_blks,
+		   super_d.group_desc_blks, super_d.journal_blks);
+	printf("%d groups of %d inode + %d data blocks\n",
+		   super_d.group_cnt, super_d.inode_blks, super_d.group_data);
+	if (mkfs_options.layout != NULL &&
+		mkfs_write_layout(mkfs_options.layout, &super_d) != LXHFS_ERROR_NONE) {
+		fprintf(stderr, "mkfs.lxhfs: cannot write %s\n", mkfs_options.layout);
+		return -1;
+	}
+	fuse_opt_free_args(&args);
+	return 0;
+}
@@ -10,27 +10,104 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--mmap", use_mmap),
+	OPTION("--cache=%d", cache_blks),
+	OPTION("--wb_age=%d", wb_age),
+	OPTION("--wb_bytes=%d", wb_bytes),
+	OPTION("--wb_inodes=%d", wb_inodes),
+	OPTION("--wb_io=%d", wb_io),
+	OPTION("--data_cache=%d", data_blks),
+	OPTION("--stats", show_stats),
 	FUSE_OPT_END
 };
 
 struct custom_options lxhfs_options;			 /* 全局选项 */
 struct lxhfs_super 	lxhfs_super; 
 /******************************************************************************
+* SECTION: 加锁的回调，在锁内调用对应的实现，FUSE多线程回调与后台刷写线程互斥
+*******************************************************************************/
+static int locked_mkdir(const char* path, mode_t mode) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_mkdir(path, mode);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_getattr(const char* path, struct stat* lxhfs_stat) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_getattr(path, lxhfs_stat);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset,
+						  struct fuse_file_info* fi) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_readdir(path, buf, filler, offset, fi);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_mknod(const char* path, mode_t mode, dev_t dev) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_mknod(path, mode, dev);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_write(const char* path, const char* buf, size_t size, off_t offset,
+						struct fuse_file_info* fi) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_write(path, buf, size, offset, fi);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_read(const char* path, char* buf, size_t size, off_t offset,
+					   struct fuse_file_info* fi) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_read(path, buf, size, offset, fi);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_truncate(const char* path, off_t offset) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_truncate(path, offset);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_unlink(const char* path) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_unlink(path);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+static int locked_rmdir(const char* path) {
+	int ret;
+	pthread_mutex_lock(&lxhfs_super.lock);
+	ret = lxhfs_rmdir(path);
+	pthread_mutex_unlock(&lxhfs_super.lock);
+	return ret;
+}
+/******************************************************************************
 * SECTION: FUSE操作定义
 *******************************************************************************/
 static struct fuse_operations operations = {
 	.init = lxhfs_init,						 /* mount文件系统 */		
 	.destroy = lxhfs_destroy,				 /* umount文件系统 */
-	.mkdir = lxhfs_mkdir,					 /* 建目录，mkdir */
-	.getattr = lxhfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
-	.readdir = lxhfs_readdir,				 /* 填充dentrys */
-	.mknod = lxhfs_mknod,					 /* 创建文件，touch相关 */
-	.write = NULL,								  	 /* 写入文件 */
-	.read = NULL,								  	 /* 读文件 */
+	.mkdir = locked_mkdir,					 /* 建目录，mkdir */
+	.getattr = locked_getattr,				 /* 获取文件属性，类似stat，必须完成 */
+	.readdir = locked_readdir,				 /* 填充dentrys */
+	.mknod = locked_mknod,					 /* 创建文件，touch相关 */
+	.write = locked_write,					 /* 写入文件 */
+	.read = locked_read,					 /* 读文件 */
 	.utimens = lxhfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
-	.truncate = NULL,						  		 /* 改变文件大小 */
-	.unlink = NULL,							  		 /* 删除文件 */
-	.rmdir	= NULL,							  		 /* 删除目录， rm -r */
+	.truncate = locked_truncate,			 /* 改变文件大小 */
+	.unlink = locked_unlink,				 /* 删除文件 */
+	.rmdir	= locked_rmdir,					 /* 删除目录， rm -r */
 	.rename = NULL,							  		 /* 重命名，mv */
 
 	.open = NULL,							
@@ -87,6 +164,7 @@ int lxhfs_mkdir(const char* path, mode_t mode) {
 	struct lxhfs_dentry* last_dentry = lxhfs_lookup(path, &is_find, &is_root);		 /*找到创建目录路径中所对应的目录项*/
 	struct lxhfs_dentry* dentry;
 	struct lxhfs_inode*  inode;
+	int ret;
 	/*如果目录存在则返回错误*/
 	if (is_find) {
 		return -LXHFS_ERROR_EXISTS;
@@ -101,7 +179,16 @@ int lxhfs_mkdir(const char* path, mode_t mode) {
 	dentry = new_dentry(fname, LXHFS_DIR); 
 	dentry->parent = last_dentry;
 	inode = lxhfs_alloc_inode(dentry);
-	lxhfs_alloc_dentry(last_dentry->inode, dentry);
+	if (inode == NULL) {
+		free(dentry);
+		return -LXHFS_ERROR_NOSPACE;
+	}
+	ret = lxhfs_alloc_dentry(last_dentry->inode, dentry);
+	if (ret < 0) {													 /*挂不进父目录时撤销新inode*/
+		lxhfs_drop_inode(inode);
+		free(dentry);
+		return ret;
+	}
 	
 	return LXHFS_ERROR_NONE;
 }
@@ -199,6 +286,7 @@ int lxhfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	struct lxhfs_dentry* dentry;
 	struct lxhfs_inode* inode;
 	char* fname;
+	int ret;
 	/*如果文件存在则返回错误*/
 	if (is_find == TRUE) {
 		return -LXHFS_ERROR_EXISTS;
@@ -217,7 +305,16 @@ int lxhfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	}
 	dentry->parent = last_dentry;
 	inode = lxhfs_alloc_inode(dentry);
-	lxhfs_alloc_dentry(last_dentry->inode, dentry);
+	if (inode == NULL) {
+		free(dentry);
+		return -LXHFS_ERROR_NOSPACE;
+	}
+	ret = lxhfs_alloc_dentry(last_dentry->inode, dentry);
+	if (ret < 0) {													 /*挂不进父目录时撤销新inode*/
+		lxhfs_drop_inode(inode);
+		free(dentry);
+		return ret;
+	}
 
 	return LXHFS_ERROR_NONE;
 }
@@ -248,7 +345,36 @@ int lxhfs_utimens(const char* path, const struct timespec tv[2]) {
  */
 int lxhfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
-	/* 选做 */
+	boolean	is_find, is_root;
+	struct lxhfs_dentry* dentry = lxhfs_lookup(path, &is_find, &is_root);
+	struct lxhfs_inode* inode;
+
+	if (is_find == FALSE) {
+		return -LXHFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (LXHFS_IS_DIR(inode)) {
+		return -LXHFS_ERROR_ISDIR;
+	}
+	/*文件不会超过整个数据区，大小也不能超出inode中的int*/
+	if (offset + size > LXHFS_BLKS_SZ((uint64_t)lxhfs_super.max_data)) {
+		return -LXHFS_ERROR_NOSPACE;
+	}
+	if (offset + size > (uint64_t)LXHFS_MAX_FILE_SZ) {
+		return -LXHFS_ERROR_FBIG;
+	}
+	/*数据块在sync时才分配，变长的部分现在就从空闲块中预订，空间不够在这里报错*/
+	if (lxhfs_data_charge(inode, offset + size) != LXHFS_ERROR_NONE) {
+		return -LXHFS_ERROR_NOSPACE;
+	}
+	/*只改内存中的数据块，数据块的分配和落盘在sync时进行*/
+	if (lxhfs_data_copy(inode, offset, (uint8_t *)buf, size, TRUE) != LXHFS_ERROR_NONE) {
+		return -LXHFS_ERROR_IO;
+	}
+	if (offset + size > inode->size) {
+		inode->size = offset + size;
+		lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY, -1);
+	}
 	return size;
 }
 
@@ -264,7 +390,28 @@ int lxhfs_write(const char* path, const char* buf, size_t size, off_t offset,
  */
 int lxhfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
-	/* 选做 */
+	boolean	is_find, is_root;
+	struct lxhfs_dentry* dentry = lxhfs_lookup(path, &is_find, &is_root);
+	struct lxhfs_inode* inode;
+
+	if (is_find == FALSE) {
+		return -LXHFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (LXHFS_IS_DIR(inode)) {
+		return -LXHFS_ERROR_ISDIR;
+	}
+	/*读到文件末尾为止*/
+	if (offset >= inode->size) {
+		return 0;
+	}
+	if (offset + size > inode->size) {
+		size = inode->size - offset;
+	}
+	/*不在内存的数据块此时才读入*/
+	if (lxhfs_data_copy(inode, offset, (uint8_t *)buf, size, FALSE) != LXHFS_ERROR_NONE) {
+		return -LXHFS_ERROR_IO;
+	}
 	return size;			   
 }
 
@@ -275,8 +422,23 @@ int lxhfs_read(const char* path, char* buf, size_t size, off_t offset,
  * @return int 0成功，否则失败
  */
 int lxhfs_unlink(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct lxhfs_dentry* dentry = lxhfs_lookup(path, &is_find, &is_root);
+	int ret;
+	if (is_find == FALSE) {
+		return -LXHFS_ERROR_NOTFOUND;
+	}
+	if (LXHFS_IS_DIR(dentry->inode)) {
+		return -LXHFS_ERROR_ISDIR;
+	}
+	/*先从目录中摘除，失败时文件原样保留；再释放inode和数据块，数据块在下一轮写回提交后discard*/
+	ret = lxhfs_drop_dentry(dentry->parent->inode, dentry);
+	if (ret < 0) {
+		return ret;
+	}
+	lxhfs_drop_inode(dentry->inode);
+	free(dentry);
+	return LXHFS_ERROR_NONE;
 }
 
 /**
@@ -292,8 +454,28 @@ int lxhfs_unlink(const char* path) {
  * @return int 0成功，否则失败
  */
 int lxhfs_rmdir(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct lxhfs_dentry* dentry = lxhfs_lookup(path, &is_find, &is_root);
+	int ret;
+	if (is_find == FALSE) {
+		return -LXHFS_ERROR_NOTFOUND;
+	}
+	if (is_root) {
+		return -LXHFS_ERROR_ACCESS;
+	}
+	if (!LXHFS_IS_DIR(dentry->inode)) {
+		return -LXHFS_ERROR_NOTDIR;
+	}
+	if (dentry->inode->dir_cnt != 0) {
+		return -LXHFS_ERROR_NOTEMPTY;
+	}
+	ret = lxhfs_drop_dentry(dentry->parent->inode, dentry);
+	if (ret < 0) {
+		return ret;
+	}
+	lxhfs_drop_inode(dentry->inode);
+	free(dentry);
+	return LXHFS_ERROR_NONE;
 }
 
 /**
@@ -341,8 +523,35 @@ int lxhfs_opendir(const char* path, struct fuse_file_info* fi) {
  * @return int 0成功，否则失败
  */
 int lxhfs_truncate(const char* path, off_t offset) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct lxhfs_dentry* dentry = lxhfs_lookup(path, &is_find, &is_root);
+	struct lxhfs_inode* inode;
+
+	if (is_find == FALSE) {
+		return -LXHFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (LXHFS_IS_DIR(inode)) {
+		return -LXHFS_ERROR_ISDIR;
+	}
+	if (offset > LXHFS_BLKS_SZ((off_t)lxhfs_super.max_data)) {
+		return -LXHFS_ERROR_NOSPACE;
+	}
+	if (offset > LXHFS_MAX_FILE_SZ) {
+		return -LXHFS_ERROR_FBIG;
+	}
+	/*截短时清零末块截掉的部分并释放之后的整块，之后再变长读出的是0*/
+	if (offset < inode->size && lxhfs_data_truncate(inode, offset) != LXHFS_ERROR_NONE) {
+		return -LXHFS_ERROR_IO;
+	}
+	if (lxhfs_data_charge(inode, offset) != LXHFS_ERROR_NONE) {
+		return -LXHFS_ERROR_NOSPACE;
+	}
+	if (offset != inode->size) {
+		inode->size = offset;
+		lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY, -1);
+	}
+	return LXHFS_ERROR_NONE;
 }
 
 
@@ -371,6 +580,12 @@ int main(int argc, char **argv)
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	lxhfs_options.device = strdup("TODO: 这里填写你的ddriver设备路径");
+	lxhfs_options.cache_blks = LXHFS_DEFAULT_CACHE_BLKS;
+	lxhfs_options.wb_age = LXHFS_DEFAULT_WB_AGE;
+	lxhfs_options.wb_bytes = LXHFS_DEFAULT_WB_BYTES;
+	lxhfs_options.wb_inodes = LXHFS_DEFAULT_WB_INODES;
+	lxhfs_options.wb_io = LXHFS_DEFAULT_WB_IO;
+	lxhfs_options.data_blks = LXHFS_DEFAULT_DATA_BLKS;
 
 	if (fuse_opt_parse(&args, &lxhfs_options, option_spec, NULL) == -1)
 		return -1;
@@ -0,0 +1,556 @@
+#include "../include/lxhfs.h"
+
+/*
+ * 位图分配器按64位字扫描：空闲位用ctz找，计数用popcount，汇总层每位对应一个字，
+ * 已满的字整段跳过。不依赖内存超级块，inode和数据位图各用一个。
+ * 预留位只在内存中，不写回磁盘，分配时和已占用的位一样跳过
+ */
+
+/**
+ * @brief 第w个字中的可用位：未占用也未预留，最后一个字超出nbits的位视为已占用
+ *
+ * @param bm
+ * @param w
+ * @return uint64_t
+ */
+static uint64_t lxhfs_bitmap_avail(struct lxhfs_bitmap *bm, int w)
+{
+    uint64_t avail = ~(bm->words[w] | bm->rsv[w]);
+    if (w == bm->nwords - 1 && bm->nbits % UINT64_BITS != 0)
+    {
+        avail &= (1ULL << (bm->nbits % UINT64_BITS)) - 1;
+    }
+    return avail;
+}
+
+/**
+ * @brief 按第w个字的当前内容更新汇总层
+ *
+ * @param bm
+ * @param w
+ */
+static void lxhfs_bitmap_update(struct lxhfs_bitmap *bm, int w)
+{
+    if (lxhfs_bitmap_avail(bm, w) == 0)
+    {
+        bm->full[w / UINT64_BITS] |= 1ULL << (w % UINT64_BITS);
+    }
+    else
+    {
+        bm->full[w / UINT64_BITS] &= ~(1ULL << (w % UINT64_BITS));
+    }
+}
+
+/**
+ * @brief 记下第w个字所在的位图块有修改
+ *
+ * @param bm
+ * @param w
+ */
+static void lxhfs_bitmap_touch(struct lxhfs_bitmap *bm, int w)
+{
+    if (bm->dirty != NULL)
+    {
+        bm->dirty[w / bm->blk_words] = 1;
+    }
+}
+
+/**
+ * @brief 在已读入的位图上建立分配器，统计空闲位并建立汇总层
+ *
+ * @param bm
+ * @param map 位图内存，需8字节对齐且至少有nbits位取整到字的大小
+ * @param nbits
+ * @return int
+ */
+int lxhfs_bitmap_init(struct lxhfs_bitmap *bm, uint8_t *map, int nbits)
+{
+    int w;
+    bm->words = (uint64_t *)map;
+    bm->nbits = nbits;
+    bm->nwords = (nbits + UINT64_BITS - 1) / UINT64_BITS;
+    bm->nfull = (bm->nwords + UINT64_BITS - 1) / UINT64_BITS;
+    bm->cursor = 0;
+    bm->nfree = 0;
+    bm->nrsv = 0;
+    bm->seg = 0;
+    bm->dirty = NULL;
+    bm->blk_words = 0;
+    bm->full = (uint64_t *)malloc(bm->nfull * sizeof(uint64_t));
+    bm->rsv = (uint64_t *)calloc(bm->nwords, sizeof(uint64_t));
+    if (bm->full == NULL || bm->rsv == NULL)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    /*不存在的字视为已满，查找时不必再判断越界*/
+    memset(bm->full, 0xff, bm->nfull * sizeof(uint64_t));
+    for (w = 0; w < bm->nwords; w++)
+    {
+        bm->nfree += __builtin_popcountll(lxhfs_bitmap_avail(bm, w));
+        lxhfs_bitmap_update(bm, w);
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 按磁盘块记录位图的修改，写回时只写有修改的块
+ *
+ * @param bm
+ * @param sz_blk 位图块的大小
+ * @return int
+ */
+int lxhfs_bitmap_track(struct lxhfs_bitmap *bm, int sz_blk)
+{
+    bm->blk_words = sz_blk / (int)sizeof(uint64_t);
+    bm->dirty = (uint8_t *)calloc((bm->nwords + bm->blk_words - 1) / bm->blk_words, 1);
+    return bm->dirty == NULL ? -LXHFS_ERROR_NOSPACE : LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放汇总层和预留位，位图内存由调用者管理
+ *
+ * @param bm
+ */
+void lxhfs_bitmap_destroy(struct lxhfs_bitmap *bm)
+{
+    free(bm->full);
+    free(bm->rsv);
+    free(bm->dirty);
+    bm->full = NULL;
+    bm->rsv = NULL;
+    bm->dirty = NULL;
+    bm->words = NULL;
+}
+
+/**
+ * @brief 占用第w个字中的第bit位
+ *
+ * @param bm
+ * @param w
+ * @param bit
+ * @return int 位号
+ */
+static int lxhfs_bitmap_take(struct lxhfs_bitmap *bm, int w, int bit)
+{
+    bm->words[w] |= 1ULL << bit;
+    bm->nfree--;
+    bm->cursor = w;
+    lxhfs_bitmap_update(bm, w);
+    lxhfs_bitmap_touch(bm, w);
+    return w * UINT64_BITS + bit;
+}
+
+/**
+ * @brief 借助汇总层从第start个字开始找第一个有空闲位的字，到末尾后绕回开头
+ *
+ * @param bm
+ * @param start
+ * @return int 位号，没有空闲位返回-LXHFS_ERROR_NOSPACE
+ */
+static int lxhfs_bitmap_search(struct lxhfs_bitmap *bm, int start)
+{
+    int i, s, w;
+    uint64_t cand;
+
+    if (bm->nfree == 0)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    /*第0轮只看start及其之后的字，第nfull轮回到起点，补上start之前的字*/
+    for (i = 0; i <= bm->nfull; i++)
+    {
+        s = (start / UINT64_BITS + i) % bm->nfull;
+        cand = ~bm->full[s];
+        if (i == 0)
+        {
+            cand &= ~0ULL << (start % UINT64_BITS);
+        }
+        if (cand == 0)
+        {
+            continue;
+        }
+        w = s * UINT64_BITS + __builtin_ctzll(cand);
+        return lxhfs_bitmap_take(bm, w, __builtin_ctzll(lxhfs_bitmap_avail(bm, w)));
+    }
+    return -LXHFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief next-fit：从游标所在的字开始找第一个空闲位并占用
+ *
+ * @param bm
+ * @return int 位号，没有空闲位返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_bitmap_alloc(struct lxhfs_bitmap *bm)
+{
+    return lxhfs_bitmap_search(bm, bm->cursor);
+}
+
+/**
+ * @brief 占用goal或其后最近的空闲位，goal之后都满时绕回开头
+ *
+ * @param bm
+ * @param goal
+ * @return int 位号，没有空闲位返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_bitmap_alloc_goal(struct lxhfs_bitmap *bm, int goal)
+{
+    int w = goal / UINT64_BITS;
+    uint64_t avail;
+
+    if (goal < 0 || goal >= bm->nbits)
+    {
+        return lxhfs_bitmap_search(bm, 0);
+    }
+    avail = lxhfs_bitmap_avail(bm, w) & (~0ULL << (goal % UINT64_BITS));
+    if (avail != 0)
+    {
+        return lxhfs_bitmap_take(bm, w, __builtin_ctzll(avail));
+    }
+    return lxhfs_bitmap_search(bm, w + 1);
+}
+
+/**
+ * @brief 统计[from, to)中可分配的位
+ *
+ * @param bm
+ * @param from
+ * @param to
+ * @return int
+ */
+int lxhfs_bitmap_count(struct lxhfs_bitmap *bm, int from, int to)
+{
+    int w, cnt = 0;
+    uint64_t avail;
+    if (to > bm->nbits)
+    {
+        to = bm->nbits;
+    }
+    for (w = from / UINT64_BITS; w * UINT64_BITS < to; w++)
+    {
+        avail = lxhfs_bitmap_avail(bm, w);
+        if (w == from / UINT64_BITS)
+        {
+            avail &= ~0ULL << (from % UINT64_BITS);
+        }
+        if ((w + 1) * UINT64_BITS > to)
+        {
+            avail &= (1ULL << (to % UINT64_BITS)) - 1;
+        }
+        cnt += __builtin_popcountll(avail);
+    }
+    return cnt;
+}
+
+/**
+ * @brief 占用指定的位
+ *
+ * @param bm
+ * @param bit
+ */
+void lxhfs_bitmap_set(struct lxhfs_bitmap *bm, int bit)
+{
+    int w = bit / UINT64_BITS;
+    uint64_t mask = 1ULL << (bit % UINT64_BITS);
+    if (bm->words[w] & mask)
+    {
+        return;
+    }
+    bm->words[w] |= mask;
+    if (bm->rsv[w] & mask)
+    {
+        bm->rsv[w] &= ~mask;
+        bm->nrsv--;
+    }
+    else
+    {
+        bm->nfree--;
+    }
+    lxhfs_bitmap_update(bm, w);
+    lxhfs_bitmap_touch(bm, w);
+}
+
+/**
+ * @brief 释放指定的位，游标不动，释放的位等下一轮再复用
+ *
+ * @param bm
+ * @param bit
+ */
+void lxhfs_bitmap_clear(struct lxhfs_bitmap *bm, int bit)
+{
+    int w = bit / UINT64_BITS;
+    uint64_t mask = 1ULL << (bit % UINT64_BITS);
+    if ((bm->words[w] & mask) == 0)
+    {
+        return;
+    }
+    bm->words[w] &= ~mask;
+    bm->nfree++;
+    bm->full[w / UINT64_BITS] &= ~(1ULL << (w % UINT64_BITS));
+    lxhfs_bitmap_touch(bm, w);
+}
+
+/**
+ * @brief 判断指定的位是否已占用
+ *
+ * @param bm
+ * @param bit
+ * @return boolean
+ */
+boolean lxhfs_bitmap_test(struct lxhfs_bitmap *bm, int bit)
+{
+    return (bm->words[bit / UINT64_BITS] >> (bit % UINT64_BITS)) & 1 ? TRUE : FALSE;
+}
+/**
+ * @brief 从bit开始连续可用的位数，最多max位，不跨过seg的整数倍
+ *
+ * @param bm
+ * @param bit
+ * @param max
+ * @return int
+ */
+static int lxhfs_bitmap_run(struct lxhfs_bitmap *bm, int bit, int max)
+{
+    int end = bm->seg > 0 ? (bit / bm->seg + 1) * bm->seg : bm->nbits;
+    int n = 0, off, cnt;
+    uint64_t used;
+
+    if (end > bm->nbits)
+    {
+        end = bm->nbits;
+    }
+    if (max > end - bit)
+    {
+        max = end - bit;
+    }
+    while (n < max)
+    {
+        off = (bit + n) % UINT64_BITS;
+        used = ~lxhfs_bitmap_avail(bm, (bit + n) / UINT64_BITS) >> off;
+        cnt = used == 0 ? UINT64_BITS - off : __builtin_ctzll(used);
+        n += cnt;
+        if (cnt < UINT64_BITS - off)
+        {
+            break;
+        }
+    }
+    return n < max ? n : max;
+}
+
+/**
+ * @brief [from, to)中第一个可用位，已满的字借助汇总层跳过
+ *
+ * @param bm
+ * @param from
+ * @param to
+ * @return int 位号，没有时返回-1
+ */
+static int lxhfs_bitmap_next(struct lxhfs_bitmap *bm, int from, int to)
+{
+    int w, bit = from;
+    uint64_t avail;
+
+    while (bit < to)
+    {
+        w = bit / UINT64_BITS;
+        if (w % UINT64_BITS == 0 && bm->full[w / UINT64_BITS] == ~0ULL)
+        {
+            bit = (w + UINT64_BITS) * UINT64_BITS;
+            continue;
+        }
+        if ((bm->full[w / UINT64_BITS] >> (w % UINT64_BITS)) & 1)
+        {
+            bit = (w + 1) * UINT64_BITS;
+            continue;
+        }
+        avail = lxhfs_bitmap_avail(bm, w) & (~0ULL << (bit % UINT64_BITS));
+        if (avail != 0)
+        {
+            bit = w * UINT64_BITS + __builtin_ctzll(avail);
+            return bit < to ? bit : -1;
+        }
+        bit = (w + 1) * UINT64_BITS;
+    }
+    return -1;
+}
+
+/**
+ * @brief 首次适配：[from, to)中第一段至少len位的连续可用位
+ *
+ * @param bm
+ * @param from
+ * @param to
+ * @param len
+ * @return int 起始位号，没有时返回-1
+ */
+static int lxhfs_bitmap_find_run(struct lxhfs_bitmap *bm, int from, int to, int len)
+{
+    int bit = from, n;
+    while ((bit = lxhfs_bitmap_next(bm, bit, to)) >= 0)
+    {
+        n = lxhfs_bitmap_run(bm, bit, len);
+        if (n >= len)
+        {
+            return bit;
+        }
+        bit += n;
+    }
+    return -1;
+}
+
+/**
+ * @brief 占用从bit开始的n个可用位
+ *
+ * @param bm
+ * @param bit
+ * @param n
+ */
+static void lxhfs_bitmap_take_run(struct lxhfs_bitmap *bm, int bit, int n)
+{
+    int i, w;
+    for (i = bit; i < bit + n; i++)
+    {
+        w = i / UINT64_BITS;
+        bm->words[w] |= 1ULL << (i % UINT64_BITS);
+        if (i % UINT64_BITS == UINT64_BITS - 1 || i == bit + n - 1)
+        {
+            lxhfs_bitmap_update(bm, w);
+            lxhfs_bitmap_touch(bm, w);
+        }
+    }
+    bm->nfree -= n;
+    bm->cursor = (bit + n - 1) / UINT64_BITS;
+}
+
+/**
+ * @brief 首次适配：先在goal之后、再从开头找第一段至少len位的连续可用位，不占用
+ *
+ * @param bm
+ * @param goal
+ * @param len
+ * @return int 起始位号，没有时返回-1
+ */
+int lxhfs_bitmap_find(struct lxhfs_bitmap *bm, int goal, int len)
+{
+    int bit;
+    if (goal < 0 || goal >= bm->nbits)
+    {
+        goal = 0;
+    }
+    bit = lxhfs_bitmap_find_run(bm, goal, bm->nbits, len);
+    return bit >= 0 ? bit : lxhfs_bitmap_find_run(bm, 0, goal, len);
+}
+
+/**
+ * @brief 分配一段连续位：找够len位的空闲段，找不到就把len减半再找，最后退化为单个位
+ *
+ * @param bm
+ * @param goal
+ * @param len 想要的位数
+ * @param got 实际分到的位数，不超过len
+ * @return int 起始位号，没有空闲位返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_bitmap_alloc_run(struct lxhfs_bitmap *bm, int goal, int len, int *got)
+{
+    int want, bit;
+    for (want = len; want > 0; want /= 2)
+    {
+        bit = lxhfs_bitmap_find(bm, goal, want);
+        if (bit >= 0)
+        {
+            *got = lxhfs_bitmap_run(bm, bit, len);
+            lxhfs_bitmap_take_run(bm, bit, *got);
+            return bit;
+        }
+    }
+    return -LXHFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief 占用从bit开始的连续可用位，用于紧接在已有的块之后续写
+ *
+ * @param bm
+ * @param bit
+ * @param len 最多占用的位数
+ * @return int 占用的位数，bit不可用时为0
+ */
+int lxhfs_bitmap_extend(struct lxhfs_bitmap *bm, int bit, int len)
+{
+    int n;
+    if (bit < 0 || bit >= bm->nbits)
+    {
+        return 0;
+    }
+    n = lxhfs_bitmap_run(bm, bit, len);
+    lxhfs_bitmap_take_run(bm, bit, n);
+    return n;
+}
+
+/**
+ * @brief 预留从bit开始的连续可用位，预留的位不再分给别人，也不写入磁盘位图
+ *
+ * @param bm
+ * @param bit
+ * @param len 最多预留的位数
+ * @return int 预留的位数，bit不可用时为0
+ */
+int lxhfs_bitmap_reserve(struct lxhfs_bitmap *bm, int bit, int len)
+{
+    int i, w, n;
+    if (bit < 0 || bit >= bm->nbits)
+    {
+        return 0;
+    }
+    n = lxhfs_bitmap_run(bm, bit, len);
+    for (i = bit; i < bit + n; i++)
+    {
+        w = i / UINT64_BITS;
+        bm->rsv[w] |= 1ULL << (i % UINT64_BITS);
+        lxhfs_bitmap_update(bm, w);
+    }
+    bm->nfree -= n;
+    bm->nrsv += n;
+    return n;
+}
+
+/**
+ * @brief 把从bit开始的n个预留位转为占用
+ *
+ * @param bm
+ * @param bit
+ * @param n
+ */
+void lxhfs_bitmap_claim(struct lxhfs_bitmap *bm, int bit, int n)
+{
+    int i, w;
+    uint64_t mask;
+    for (i = bit; i < bit + n; i++)
+    {
+        w = i / UINT64_BITS;
+        mask = 1ULL << (i % UINT64_BITS);
+        bm->rsv[w] &= ~mask;
+        bm->words[w] |= mask;
+        lxhfs_bitmap_touch(bm, w);
+    }
+    bm->nrsv -= n;
+}
+
+/**
+ * @brief 取消从bit开始的n个预留位
+ *
+ * @param bm
+ * @param bit
+ * @param n
+ */
+void lxhfs_bitmap_unreserve(struct lxhfs_bitmap *bm, int bit, int n)
+{
+    int i, w;
+    for (i = bit; i < bit + n; i++)
+    {
+        w = i / UINT64_BITS;
+        bm->rsv[w] &= ~(1ULL << (i % UINT64_BITS));
+        bm->full[w / UINT64_BITS] &= ~(1ULL << (w % UINT64_BITS));
+    }
+    bm->nfree += n;
+    bm->nrsv -= n;
+}
@@ -0,0 +1,352 @@
+#include "../include/lxhfs.h"
+
+/*
+ * 目录项在内存中按文件名哈希分桶，查找不再顺着brother链表逐个比较。
+ * 超过一个块的目录在磁盘上带htree式的索引：第0块为索引根，索引项按哈希升序指向
+ * 下一层索引块或叶块，叶块中的目录项按哈希排序。索引在写回时整体重建，
+ * 查找时只需读索引和一个叶块。不依赖内存超级块，块大小由调用者给出
+ */
+
+/**
+ * @brief 文件名哈希，FNV-1a。写在磁盘索引中，不能更改
+ *
+ * @param fname
+ * @return uint32_t
+ */
+uint32_t lxhfs_dir_hash(const char *fname)
+{
+    uint32_t hash = 2166136261U;
+    while (*fname)
+    {
+        hash ^= (uint8_t)*fname++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * @brief 桶数翻倍，按已存的哈希值重新分桶
+ *
+ * @param inode
+ * @return int
+ */
+static int lxhfs_dir_rehash(struct lxhfs_inode *inode)
+{
+    int sz = inode->dir_hash_sz > 0 ? inode->dir_hash_sz * 2 : LXHFS_DIR_HASH_MIN;
+    struct lxhfs_dentry **table = (struct lxhfs_dentry **)calloc(sz, sizeof(struct lxhfs_dentry *));
+    struct lxhfs_dentry *dentry, *next;
+    int i;
+
+    if (table == NULL)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < inode->dir_hash_sz; i++)
+    {
+        for (dentry = inode->dir_hash[i]; dentry != NULL; dentry = next)
+        {
+            next = dentry->hash_next;
+            dentry->hash_next = table[dentry->hash & (sz - 1)];
+            table[dentry->hash & (sz - 1)] = dentry;
+        }
+    }
+    free(inode->dir_hash);
+    inode->dir_hash = table;
+    inode->dir_hash_sz = sz;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把目录项挂到目录的链表头和哈希表中，不改dir_cnt
+ *
+ * @param inode 目录
+ * @param dentry
+ * @return int
+ */
+int lxhfs_dir_add(struct lxhfs_inode *inode, struct lxhfs_dentry *dentry)
+{
+    int slot;
+    if (inode->dir_hash_cnt >= inode->dir_hash_sz && lxhfs_dir_rehash(inode) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    dentry->hash = lxhfs_dir_hash(dentry->fname);
+    slot = dentry->hash & (inode->dir_hash_sz - 1);
+    dentry->hash_next = inode->dir_hash[slot];
+    inode->dir_hash[slot] = dentry;
+    inode->dir_hash_cnt++;
+
+    dentry->brother = inode->dentrys;
+    inode->dentrys = dentry;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把目录项从目录的链表和哈希表中摘下，不释放
+ *
+ * @param inode 目录
+ * @param dentry
+ * @return int
+ */
+int lxhfs_dir_remove(struct lxhfs_inode *inode, struct lxhfs_dentry *dentry)
+{
+    struct lxhfs_dentry **link = &inode->dentrys;
+    while (*link != NULL && *link != dentry)
+    {
+        link = &(*link)->brother;
+    }
+    if (*link == NULL)
+    {
+        return -LXHFS_ERROR_NOTFOUND;
+    }
+    *link = dentry->brother;
+
+    link = &inode->dir_hash[dentry->hash & (inode->dir_hash_sz - 1)];
+    while (*link != dentry)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = dentry->hash_next;
+    inode->dir_hash_cnt--;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在已读入内存的目录项中按文件名查找
+ *
+ * @param inode 目录
+ * @param fname
+ * @return struct lxhfs_dentry* 没有时返回NULL
+ */
+struct lxhfs_dentry *lxhfs_dir_find(struct lxhfs_inode *inode, const char *fname)
+{
+    struct lxhfs_dentry *dentry;
+    uint32_t hash;
+
+    if (inode->dir_hash_sz == 0)
+    {
+        return NULL;
+    }
+    hash = lxhfs_dir_hash(fname);
+    for (dentry = inode->dir_hash[hash & (inode->dir_hash_sz - 1)]; dentry != NULL; dentry = dentry->hash_next)
+    {
+        if (dentry->hash == hash && strcmp(dentry->fname, fname) == 0)
+        {
+            return dentry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 把磁盘目录项中还不在内存的有效项加入目录，用于按需读入的叶块
+ *
+ * @param inode 目录
+ * @param dentry_d
+ * @param cnt
+ * @return int
+ */
+int lxhfs_dir_fill(struct lxhfs_inode *inode, struct lxhfs_dentry_d *dentry_d, int cnt)
+{
+    struct lxhfs_dentry *sub_dentry;
+    int i;
+    for (i = 0; i < cnt; i++, dentry_d++)
+    {
+        if (!dentry_d->valid || lxhfs_dir_find(inode, dentry_d->fname) != NULL)
+        {
+            continue;
+        }
+        sub_dentry = new_dentry(dentry_d->fname, dentry_d->ftype);
+        sub_dentry->parent = inode->dentry;
+        sub_dentry->ino = dentry_d->ino;
+        if (lxhfs_dir_add(inode, sub_dentry) != LXHFS_ERROR_NONE)
+        {
+            free(sub_dentry);
+            return -LXHFS_ERROR_NOSPACE;
+        }
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放哈希表，目录项由调用者释放
+ *
+ * @param inode
+ */
+void lxhfs_dir_destroy(struct lxhfs_inode *inode)
+{
+    free(inode->dir_hash);
+    inode->dir_hash = NULL;
+    inode->dir_hash_sz = inode->dir_hash_cnt = 0;
+}
+
+/**
+ * @brief 把内存中的目录项转换为磁盘目录项
+ *
+ * @param dentry_d
+ * @param dentry
+ */
+void lxhfs_dentry_to_disk(struct lxhfs_dentry_d *dentry_d, struct lxhfs_dentry *dentry)
+{
+    memcpy(dentry_d->fname, dentry->fname, LXHFS_MAX_FILE_NAME);
+    dentry_d->ftype = dentry->ftype;
+    dentry_d->ino = dentry->ino;
+    dentry_d->valid = TRUE;
+}
+
+static int lxhfs_dx_cmp(const void *a, const void *b)
+{
+    const struct lxhfs_dentry *x = *(const struct lxhfs_dentry *const *)a;
+    const struct lxhfs_dentry *y = *(const struct lxhfs_dentry *const *)b;
+    if (x->hash != y->hash)
+    {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return strcmp(x->fname, y->fname);
+}
+
+/**
+ * @brief 写一个索引块
+ *
+ * @param blk
+ * @param levels
+ * @param hashes 各子块的最小哈希
+ * @param first 第一个子块的块号，其余子块紧随其后
+ * @param count
+ */
+static void lxhfs_dx_fill(uint8_t *blk, int levels, uint32_t *hashes, int first, int count)
+{
+    struct lxhfs_dx_head *head = (struct lxhfs_dx_head *)blk;
+    struct lxhfs_dx_entry *entry = (struct lxhfs_dx_entry *)(head + 1);
+    int i;
+    head->magic = LXHFS_DX_MAGIC;
+    head->levels = levels;
+    head->count = count;
+    for (i = 0; i < count; i++)
+    {
+        entry[i].hash = hashes[i];
+        entry[i].blk = first + i;
+    }
+}
+
+/**
+ * @brief 由内存中的全部目录项重建带索引的目录：目录项按哈希排序后依次填满叶块，
+ *        同一个哈希值不跨叶块；叶块数超过一个索引块的容量时加一层索引块。
+ *        块的顺序是索引根、下层索引块、叶块
+ *
+ * @param inode 目录，目录项须已全部读入
+ * @param sz_blk
+ * @param blks 目录占用的块数
+ * @return uint8_t* 整个目录的内容，由调用者释放；目录只需一个块、
+ *         超过两层索引或同一个哈希值的目录项多于一个叶块时返回NULL，目录按线性格式写
+ */
+uint8_t *lxhfs_dx_build(struct lxhfs_inode *inode, int sz_blk, int *blks)
+{
+    int per_leaf = sz_blk / (int)sizeof(struct lxhfs_dentry_d);
+    int fan = LXHFS_DX_PER_BLK(sz_blk);
+    int cnt = inode->dir_hash_cnt;
+    int leaves = 0, nodes = 0, index_blks, i, end, n;
+    struct lxhfs_dentry **ents;
+    struct lxhfs_dentry *dentry;
+    struct lxhfs_dentry_d *dentry_d;
+    int *starts;
+    uint32_t *hashes;
+    uint8_t *buf = NULL;
+
+    if (cnt <= per_leaf)
+    {
+        return NULL;
+    }
+    ents = (struct lxhfs_dentry **)malloc(cnt * sizeof(struct lxhfs_dentry *));
+    starts = (int *)malloc((cnt + 1) * sizeof(int));
+    hashes = (uint32_t *)malloc(cnt * sizeof(uint32_t));
+    for (i = 0, dentry = inode->dentrys; dentry != NULL && i < cnt; dentry = dentry->brother)
+    {
+        ents[i++] = dentry;
+    }
+    qsort(ents, cnt, sizeof(struct lxhfs_dentry *), lxhfs_dx_cmp);
+
+    /*划分叶块：叶块的边界退回到同一个哈希值的第一项*/
+    for (i = 0; i < cnt; i = end)
+    {
+        end = i + per_leaf < cnt ? i + per_leaf : cnt;
+        while (end < cnt && end > i && ents[end]->hash == ents[end - 1]->hash)
+        {
+            end--;
+        }
+        if (end == i)
+        {
+            break;
+        }
+        hashes[leaves] = ents[i]->hash;
+        starts[leaves++] = i;
+    }
+    starts[leaves] = cnt;
+    nodes = leaves > fan ? (leaves + fan - 1) / fan : 0;
+
+    if (i == cnt && nodes <= fan)
+    {
+        index_blks = 1 + nodes;
+        *blks = index_blks + leaves;
+        buf = (uint8_t *)calloc(*blks, sz_blk);
+        if (nodes == 0)
+        {
+            lxhfs_dx_fill(buf, 0, hashes, index_blks, leaves);
+        }
+        else
+        {
+            for (i = 0; i < nodes; i++)
+            {
+                n = leaves - i * fan < fan ? leaves - i * fan : fan;
+                lxhfs_dx_fill(buf + (1 + i) * sz_blk, 0, hashes + i * fan, index_blks + i * fan, n);
+                hashes[i] = hashes[i * fan]; /* 第i个下层索引块的最小哈希，之前的项已经用过 */
+            }
+            lxhfs_dx_fill(buf, 1, hashes, 1, nodes);
+        }
+        for (n = 0; n < leaves; n++)
+        {
+            dentry_d = (struct lxhfs_dentry_d *)(buf + (index_blks + n) * sz_blk);
+            for (i = starts[n]; i < starts[n + 1]; i++)
+            {
+                lxhfs_dentry_to_disk(dentry_d++, ents[i]);
+            }
+        }
+    }
+    free(ents);
+    free(starts);
+    free(hashes);
+    return buf;
+}
+
+/**
+ * @brief 在索引块中找哈希值所在的子块：最后一个最小哈希不超过hash的索引项
+ *
+ * @param blk 索引块
+ * @param hash
+ * @return int 子块在目录中的块号，不是索引块时返回-1
+ */
+int lxhfs_dx_next(uint8_t *blk, uint32_t hash)
+{
+    struct lxhfs_dx_head *head = (struct lxhfs_dx_head *)blk;
+    struct lxhfs_dx_entry *entry = (struct lxhfs_dx_entry *)(head + 1);
+    int lo = 0, hi, mid;
+
+    if (head->magic != LXHFS_DX_MAGIC || head->count == 0)
+    {
+        return -1;
+    }
+    hi = head->count - 1;
+    while (lo < hi)
+    {
+        mid = (lo + hi + 1) / 2;
+        if (entry[mid].hash <= hash)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return entry[lo].blk;
+}
@@ -0,0 +1,256 @@
+#include "../include/lxhfs.h"
+
+extern struct lxhfs_super lxhfs_super;
+
+/**
+ * @brief 新建或刚读入的inode还没有任何数据块
+ *
+ * @param inode
+ */
+void lxhfs_extent_init(struct lxhfs_inode *inode)
+{
+    int i;
+    inode->data = NULL;
+    inode->dno = NULL;
+    inode->data_dirty = NULL;
+    inode->data_dirty_cnt = 0;
+    inode->blk_cap = 0;
+    for (i = 0; i < LXHFS_EXT_ROOT; i++)
+    {
+        inode->ext_dno[i] = LXHFS_DNO_NONE;
+    }
+}
+
+/**
+ * @brief 扩大逐块映射，使其至少容纳blks个块，新增的块未分配、不在内存、不脏
+ *
+ * @param inode
+ * @param blks
+ * @return int
+ */
+int lxhfs_extent_grow(struct lxhfs_inode *inode, int blks)
+{
+    int cap = inode->blk_cap > 0 ? inode->blk_cap : UINT32_BITS;
+    int i;
+    if (blks <= inode->blk_cap)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    while (cap < blks)
+    {
+        cap *= 2;
+    }
+    inode->dno = (int *)realloc(inode->dno, cap * sizeof(int));
+    inode->data = (uint8_t **)realloc(inode->data, cap * sizeof(uint8_t *));
+    inode->data_dirty = (uint32_t *)realloc(inode->data_dirty, cap / UINT32_BITS * sizeof(uint32_t));
+    for (i = inode->blk_cap; i < cap; i++)
+    {
+        inode->dno[i] = LXHFS_DNO_NONE;
+        inode->data[i] = NULL;
+    }
+    memset(inode->data_dirty + inode->blk_cap / UINT32_BITS, 0,
+           (cap - inode->blk_cap) / UINT32_BITS * sizeof(uint32_t));
+    inode->blk_cap = cap;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放逐块映射本身，数据块和区段块需先释放
+ *
+ * @param inode
+ */
+void lxhfs_extent_destroy(struct lxhfs_inode *inode)
+{
+    free(inode->dno);
+    free(inode->data);
+    free(inode->data_dirty);
+    lxhfs_extent_init(inode);
+}
+
+/**
+ * @brief 把逐块映射中物理上连续的块合并成区段。区段不超过LXHFS_EXT_ROOT个时
+ *        直接放在inode中，否则写入区段块，inode中只记区段块号；区段块按需分配和释放
+ *
+ * @param inode
+ * @param inode_d 填写ext_cnt、ext_depth和ext[]
+ * @return int
+ */
+int lxhfs_extent_pack(struct lxhfs_inode *inode, struct lxhfs_inode_d *inode_d)
+{
+    struct lxhfs_extent_d *exts = NULL;
+    uint8_t *blk_buf;
+    int cnt = 0, need = 0, blk, i, dno, len;
+
+    for (blk = 0; blk < inode->blk_cap; blk++)
+    {
+        if (inode->dno[blk] == LXHFS_DNO_NONE)
+        {
+            continue;
+        }
+        if (cnt > 0 && exts[cnt - 1].lblk + exts[cnt - 1].len == (uint32_t)blk &&
+            exts[cnt - 1].start + exts[cnt - 1].len == (uint32_t)inode->dno[blk])
+        {
+            exts[cnt - 1].len++;
+            continue;
+        }
+        if (cnt == LXHFS_EXT_MAX())
+        {
+            LXHFS_DBG("[%s] too many extents\n", __func__);
+            free(exts);
+            return -LXHFS_ERROR_NOSPACE;
+        }
+        if ((cnt & (cnt - 1)) == 0)
+        { /* 容量按2的幂增长 */
+            exts = (struct lxhfs_extent_d *)realloc(exts, (cnt ? cnt * 2 : 1) * sizeof(struct lxhfs_extent_d));
+        }
+        exts[cnt].lblk = blk;
+        exts[cnt].start = inode->dno[blk];
+        exts[cnt].len = 1;
+        cnt++;
+    }
+
+    memset(inode_d->ext, 0, sizeof(inode_d->ext));
+    inode_d->ext_cnt = cnt;
+    inode_d->ext_depth = cnt > LXHFS_EXT_ROOT ? 1 : 0;
+    if (inode_d->ext_depth == 0)
+    {
+        memcpy(inode_d->ext, exts, cnt * sizeof(struct lxhfs_extent_d));
+    }
+    else
+    {
+        need = LXHFS_ROUND_UP(cnt, LXHFS_EXT_PER_BLK()) / LXHFS_EXT_PER_BLK();
+    }
+
+    /*区段块只增减需要的个数，原有的块原位重写*/
+    for (i = 0; i < LXHFS_EXT_ROOT; i++)
+    {
+        if (i < need && inode->ext_dno[i] == LXHFS_DNO_NONE)
+        {
+            dno = lxhfs_alloc_data(lxhfs_group_goal(inode, 0)); /* 区段块也放在inode所在的块组 */
+            if (dno < 0)
+            {
+                free(exts);
+                return dno;
+            }
+            inode->ext_dno[i] = dno;
+        }
+        else if (i >= need && inode->ext_dno[i] != LXHFS_DNO_NONE)
+        {
+            lxhfs_free_data(inode->ext_dno[i]);
+            inode->ext_dno[i] = LXHFS_DNO_NONE;
+        }
+    }
+
+    blk_buf = need > 0 ? (uint8_t *)malloc(LXHFS_BLK_SZ()) : NULL;
+    for (i = 0; i < need; i++)
+    {
+        len = cnt - i * LXHFS_EXT_PER_BLK() < LXHFS_EXT_PER_BLK() ? cnt - i * LXHFS_EXT_PER_BLK() : LXHFS_EXT_PER_BLK();
+        memset(blk_buf, 0, LXHFS_BLK_SZ());
+        memcpy(blk_buf, exts + i * LXHFS_EXT_PER_BLK(), len * sizeof(struct lxhfs_extent_d));
+        /*区段块是元数据，与inode在同一个事务里*/
+        if (lxhfs_journal_write(LXHFS_DATA_OFS(inode->ext_dno[i]), blk_buf, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+        {
+            LXHFS_DBG("[%s] io error\n", __func__);
+            free(blk_buf);
+            free(exts);
+            return -LXHFS_ERROR_IO;
+        }
+        inode_d->ext[i].lblk = exts[i * LXHFS_EXT_PER_BLK()].lblk;
+        inode_d->ext[i].start = inode->ext_dno[i];
+        inode_d->ext[i].len = len;
+    }
+    free(blk_buf);
+    free(exts);
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把一个区段展开到逐块映射
+ *
+ * @param inode
+ * @param ext
+ * @return int
+ */
+int lxhfs_extent_map(struct lxhfs_inode *inode, struct lxhfs_extent_d *ext)
+{
+    uint32_t i;
+    if (ext->start + ext->len > (uint32_t)lxhfs_super.max_data)
+    {
+        LXHFS_DBG("[%s] bad extent %u+%u\n", __func__, ext->start, ext->len);
+        return -LXHFS_ERROR_IO;
+    }
+    lxhfs_extent_grow(inode, ext->lblk + ext->len);
+    for (i = 0; i < ext->len; i++)
+    {
+        inode->dno[ext->lblk + i] = ext->start + i;
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 由磁盘inode的区段树建立逐块映射，需要时读入区段块
+ *
+ * @param inode
+ * @param inode_d
+ * @return int
+ */
+int lxhfs_extent_unpack(struct lxhfs_inode *inode, struct lxhfs_inode_d *inode_d)
+{
+    struct lxhfs_extent_d *exts;
+    uint8_t *blk_buf;
+    int i, j, roots;
+
+    if (inode_d->ext_depth == 0)
+    {
+        for (i = 0; i < inode_d->ext_cnt && i < LXHFS_EXT_ROOT; i++)
+        {
+            if (lxhfs_extent_map(inode, &inode_d->ext[i]) != LXHFS_ERROR_NONE)
+            {
+                return -LXHFS_ERROR_IO;
+            }
+        }
+        return LXHFS_ERROR_NONE;
+    }
+
+    roots = LXHFS_ROUND_UP(inode_d->ext_cnt, LXHFS_EXT_PER_BLK()) / LXHFS_EXT_PER_BLK();
+    blk_buf = (uint8_t *)malloc(LXHFS_BLK_SZ());
+    exts = (struct lxhfs_extent_d *)blk_buf;
+    for (i = 0; i < roots && i < LXHFS_EXT_ROOT; i++)
+    {
+        inode->ext_dno[i] = inode_d->ext[i].start;
+        if (lxhfs_driver_read(LXHFS_DATA_OFS(inode_d->ext[i].start), blk_buf, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+        {
+            LXHFS_DBG("[%s] io error\n", __func__);
+            free(blk_buf);
+            return -LXHFS_ERROR_IO;
+        }
+        for (j = 0; j < (int)inode_d->ext[i].len && j < LXHFS_EXT_PER_BLK(); j++)
+        {
+            if (lxhfs_extent_map(inode, &exts[j]) != LXHFS_ERROR_NONE)
+            {
+                free(blk_buf);
+                return -LXHFS_ERROR_IO;
+            }
+        }
+    }
+    free(blk_buf);
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放inode的区段块
+ *
+ * @param inode
+ */
+void lxhfs_extent_free(struct lxhfs_inode *inode)
+{
+    int i;
+    for (i = 0; i < LXHFS_EXT_ROOT; i++)
+    {
+        if (inode->ext_dno[i] != LXHFS_DNO_NONE)
+        {
+            lxhfs_free_data(inode->ext_dno[i]);
+            inode->ext_dno[i] = LXHFS_DNO_NONE;
+        }
+    }
+}
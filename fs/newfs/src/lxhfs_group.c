@@ -0,0 +1,221 @@
+#include "../include/lxhfs.h"
+
+extern struct lxhfs_super lxhfs_super;
+
+/**
+ * @brief 读入块组描述符表，空闲数按位图重新统计，描述符中只有目录数需要沿用
+ *
+ * @return int
+ */
+int lxhfs_group_init()
+{
+    struct lxhfs_group_d *group;
+    int size = LXHFS_BLKS_SZ(lxhfs_super.group_desc_blks);
+    int g;
+
+    lxhfs_super.groups = (struct lxhfs_group_d *)calloc(1, size);
+    lxhfs_super.group_dirty = (uint8_t *)calloc(lxhfs_super.group_desc_blks, 1);
+    if (lxhfs_super.group_dirty == NULL ||
+        lxhfs_driver_read(lxhfs_super.group_desc_offset, (uint8_t *)lxhfs_super.groups, size) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    for (g = 0; g < lxhfs_super.group_cnt; g++)
+    {
+        group = &lxhfs_super.groups[g];
+        group->free_inodes = lxhfs_bitmap_count(&lxhfs_super.bm_inode, g * lxhfs_super.group_inodes,
+                                                (g + 1) * lxhfs_super.group_inodes);
+        group->free_data = lxhfs_bitmap_count(&lxhfs_super.bm_data, g * lxhfs_super.group_data,
+                                              (g + 1) * lxhfs_super.group_data);
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 块组的计数有变化，记下所在的描述符块
+ *
+ * @param g
+ */
+void lxhfs_group_touch(int g)
+{
+    lxhfs_super.group_dirty[g * (int)sizeof(struct lxhfs_group_d) / LXHFS_BLK_SZ()] = 1;
+}
+
+/**
+ * @brief 描述符表与位图在同一个事务里写回，只写有修改的块
+ *
+ * @return int
+ */
+int lxhfs_group_sync()
+{
+    int blk;
+    for (blk = 0; blk < lxhfs_super.group_desc_blks; blk++)
+    {
+        if (!lxhfs_super.group_dirty[blk])
+        {
+            continue;
+        }
+        if (lxhfs_journal_write(lxhfs_super.group_desc_offset + LXHFS_BLKS_SZ(blk),
+                                (uint8_t *)lxhfs_super.groups + LXHFS_BLKS_SZ(blk), LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        lxhfs_super.group_dirty[blk] = 0;
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+void lxhfs_group_destroy()
+{
+    free(lxhfs_super.groups);
+    free(lxhfs_super.group_dirty);
+    lxhfs_super.groups = NULL;
+    lxhfs_super.group_dirty = NULL;
+}
+
+/**
+ * @brief Orlov：新目录尽量分散。顶层目录找空闲inode和数据块都不低于平均、目录数最少的块组；
+ *        深层目录在父目录的块组还宽裕时留在原处，否则向后找一个宽裕的块组
+ *
+ * @param parent 父目录所在的块组
+ * @param is_top 父目录是根目录
+ * @return int 块组号，都满时返回-LXHFS_ERROR_NOSPACE
+ */
+static int lxhfs_group_find_dir(int parent, boolean is_top)
+{
+    struct lxhfs_group_d *group;
+    int cnt = lxhfs_super.group_cnt;
+    int avg_inodes = lxhfs_super.bm_inode.nfree / cnt;
+    int avg_data = lxhfs_super.bm_data.nfree / cnt;
+    int avg_dirs = 0, max_dirs, min_inodes, min_data;
+    int best = -1, i, g;
+
+    for (g = 0; g < cnt; g++)
+    {
+        avg_dirs += lxhfs_super.groups[g].dirs;
+    }
+    avg_dirs /= cnt;
+
+    if (is_top)
+    {
+        for (i = 1; i <= cnt; i++)
+        { /* 从父目录的下一个块组开始，目录数相同时自然错开 */
+            g = (parent + i) % cnt;
+            group = &lxhfs_super.groups[g];
+            if (group->free_inodes == 0 || (int)group->free_inodes < avg_inodes || (int)group->free_data < avg_data)
+            {
+                continue;
+            }
+            if (best < 0 || group->dirs < lxhfs_super.groups[best].dirs ||
+                (group->dirs == lxhfs_super.groups[best].dirs && group->free_data > lxhfs_super.groups[best].free_data))
+            {
+                best = g;
+            }
+        }
+        if (best >= 0)
+        {
+            return best;
+        }
+    }
+    else
+    {
+        max_dirs = avg_dirs + lxhfs_super.group_inodes / 16;
+        min_inodes = avg_inodes - lxhfs_super.group_inodes / 4;
+        min_data = avg_data - lxhfs_super.group_data / 4;
+        for (i = 0; i < cnt; i++)
+        {
+            g = (parent + i) % cnt;
+            group = &lxhfs_super.groups[g];
+            if (group->free_inodes > 0 && (int)group->dirs < max_dirs &&
+                (int)group->free_inodes >= min_inodes && (int)group->free_data >= min_data)
+            {
+                return g;
+            }
+        }
+    }
+
+    /*都不宽裕时退而求其次：空闲inode不低于平均，最后只要还有空闲inode*/
+    for (i = 0; i < cnt; i++)
+    {
+        g = (parent + i) % cnt;
+        if (lxhfs_super.groups[g].free_inodes > 0 && (int)lxhfs_super.groups[g].free_inodes >= avg_inodes)
+        {
+            return g;
+        }
+    }
+    for (i = 0; i < cnt; i++)
+    {
+        g = (parent + i) % cnt;
+        if (lxhfs_super.groups[g].free_inodes > 0)
+        {
+            return g;
+        }
+    }
+    return -LXHFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief 文件放在父目录的块组；满了先按平方步长跳着找，再逐个找
+ *
+ * @param parent 父目录所在的块组
+ * @return int 块组号，都满时返回-LXHFS_ERROR_NOSPACE
+ */
+static int lxhfs_group_find_file(int parent)
+{
+    int cnt = lxhfs_super.group_cnt;
+    int i, g = parent;
+
+    if (lxhfs_super.groups[parent].free_inodes > 0 && lxhfs_super.groups[parent].free_data > 0)
+    {
+        return parent;
+    }
+    for (i = 1; i < cnt; i <<= 1)
+    {
+        g = (g + i) % cnt;
+        if (lxhfs_super.groups[g].free_inodes > 0 && lxhfs_super.groups[g].free_data > 0)
+        {
+            return g;
+        }
+    }
+    for (i = 0; i < cnt; i++)
+    {
+        g = (parent + i) % cnt;
+        if (lxhfs_super.groups[g].free_inodes > 0)
+        {
+            return g;
+        }
+    }
+    return -LXHFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief 为新inode选择块组
+ *
+ * @param dentry 新inode的目录项，parent已经设置
+ * @return int 块组号，都满时返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_group_find(struct lxhfs_dentry *dentry)
+{
+    int parent = dentry->parent != NULL ? LXHFS_INO_GROUP(dentry->parent->ino) : 0;
+    if (dentry->ftype == LXHFS_DIR)
+    {
+        return lxhfs_group_find_dir(parent, dentry->parent == NULL || dentry->parent->ino == LXHFS_ROOT_INO);
+    }
+    return lxhfs_group_find_file(parent);
+}
+
+/**
+ * @brief 文件第blk块的分配目标：紧接前一块，否则是inode所在块组数据片的开头
+ *
+ * @param inode
+ * @param blk
+ * @return int 数据块号
+ */
+int lxhfs_group_goal(struct lxhfs_inode *inode, int blk)
+{
+    if (blk > 0 && blk <= inode->blk_cap && inode->dno[blk - 1] != LXHFS_DNO_NONE)
+    {
+        return inode->dno[blk - 1] + 1;
+    }
+    return LXHFS_INO_GROUP(inode->ino) * lxhfs_super.group_data;
+}
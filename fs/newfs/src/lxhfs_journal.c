@@ -0,0 +1,515 @@
+#include "../include/lxhfs.h"
+
+extern struct lxhfs_super lxhfs_super;
+
+/**
+ * @brief 块镜像的校验和(FNV-1a)，写在提交块里，重放时校验
+ *
+ * @param data
+ * @param size
+ * @param csum 上一段的结果，第一段传0
+ * @return uint32_t
+ */
+uint32_t lxhfs_journal_csum(uint8_t *data, int size, uint32_t csum)
+{
+    int i;
+    if (csum == 0)
+    {
+        csum = 2166136261u;
+    }
+    for (i = 0; i < size; i++)
+    {
+        csum = (csum ^ data[i]) * 16777619u;
+    }
+    return csum;
+}
+
+/**
+ * @brief 直接读写日志区，不经过块缓存
+ *
+ * @param blk 日志区内的块号
+ * @param buf
+ * @param blks
+ * @param is_write
+ * @param flags 写时传给设备的DDRIVER_RWF_*
+ * @return int
+ */
+int lxhfs_journal_io(int blk, uint8_t *buf, int blks, boolean is_write, int flags)
+{
+    struct iovec iov;
+    int size = LXHFS_BLKS_SZ(blks);
+    if (!is_write)
+    {
+        return ddriver_pread(LXHFS_DRIVER(), (char *)buf, size, LXHFS_JNL_OFS(blk)) == size ? LXHFS_ERROR_NONE : -LXHFS_ERROR_IO;
+    }
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    return ddriver_pwritev2(LXHFS_DRIVER(), &iov, 1, LXHFS_JNL_OFS(blk), flags) == size ? LXHFS_ERROR_NONE : -LXHFS_ERROR_IO;
+}
+
+/**
+ * @brief 写日志超级块，其后第一个事务的序号为seq
+ *
+ * @param seq
+ * @return int
+ */
+int lxhfs_journal_reset(uint64_t seq)
+{
+    uint8_t *blk = (uint8_t *)calloc(1, LXHFS_BLK_SZ());
+    struct lxhfs_jnl_d *jsb = (struct lxhfs_jnl_d *)blk;
+    int ret;
+    jsb->magic = LXHFS_JNL_MAGIC;
+    jsb->type = LXHFS_JNL_SUPER;
+    jsb->seq = seq;
+    ret = lxhfs_journal_io(0, blk, 1, TRUE, DDRIVER_RWF_FUA);
+    free(blk);
+    lxhfs_super.jnl_seq = seq;
+    lxhfs_super.jnl_head = 1;
+    return ret;
+}
+
+/**
+ * @brief 查找一个元数据块在日志中的记录
+ *
+ * @param blkno
+ * @return int 下标，没有返回-1
+ */
+int lxhfs_journal_find(uint64_t blkno)
+{
+    int i;
+    for (i = 0; i < lxhfs_super.jnl_cnt; i++)
+    {
+        if (lxhfs_super.jnl_blks[i].blkno == blkno)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 删去第i条记录，最后一条挪到该位置
+ *
+ * @param i
+ */
+void lxhfs_journal_remove(int i)
+{
+    free(lxhfs_super.jnl_blks[i].data);
+    free(lxhfs_super.jnl_blks[i].ckpt);
+    lxhfs_super.jnl_blks[i] = lxhfs_super.jnl_blks[--lxhfs_super.jnl_cnt];
+}
+
+/**
+ * @brief 写元数据(inode、位图、超级块、目录块)。不写原位，只记入运行中的事务，
+ *        提交时写日志，检查点时才写回原位。未启用日志时直接写
+ *
+ * @param offset
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int lxhfs_journal_write(uint64_t offset, uint8_t *in_content, int size)
+{
+    struct lxhfs_jblk *jblk;
+    uint64_t blkno;
+    int i, bias, len, done = 0;
+    if (lxhfs_super.journal_blks == 0)
+    {
+        return lxhfs_driver_write(offset, in_content, size);
+    }
+    while (done < size)
+    {
+        blkno = LXHFS_BUF_BLKNO(offset + done);
+        bias = (offset + done) % LXHFS_BLK_SZ();
+        len = LXHFS_BLK_SZ() - bias < size - done ? LXHFS_BLK_SZ() - bias : size - done;
+        i = lxhfs_journal_find(blkno);
+        if (i < 0)
+        {
+            if (lxhfs_super.jnl_cnt == lxhfs_super.jnl_cap)
+            {
+                lxhfs_super.jnl_cap = lxhfs_super.jnl_cap ? 2 * lxhfs_super.jnl_cap : 16;
+                lxhfs_super.jnl_blks = (struct lxhfs_jblk *)realloc(lxhfs_super.jnl_blks,
+                                                                    lxhfs_super.jnl_cap * sizeof(struct lxhfs_jblk));
+            }
+            jblk = &lxhfs_super.jnl_blks[lxhfs_super.jnl_cnt];
+            jblk->blkno = blkno;
+            jblk->ckpt = NULL;
+            jblk->data = (uint8_t *)malloc(LXHFS_BLK_SZ());
+            /*只改部分内容时，以原位上的内容为底*/
+            if (len != LXHFS_BLK_SZ() &&
+                lxhfs_driver_read(LXHFS_BLKS_SZ(blkno), jblk->data, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+            {
+                free(jblk->data);
+                return -LXHFS_ERROR_IO;
+            }
+            lxhfs_super.jnl_cnt++;
+        }
+        else
+        {
+            jblk = &lxhfs_super.jnl_blks[i];
+        }
+        memcpy(jblk->data + bias, in_content + done, len);
+        jblk->dirty = TRUE;
+        done += len;
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 读到的内容用日志中较新的元数据覆盖，原位上的可能尚未检查点
+ *
+ * @param offset
+ * @param out_content
+ * @param size
+ */
+void lxhfs_journal_overlay(uint64_t offset, uint8_t *out_content, int size)
+{
+    struct lxhfs_jblk *jblk;
+    uint64_t lo, hi;
+    int i;
+    for (i = 0; i < lxhfs_super.jnl_cnt; i++)
+    {
+        jblk = &lxhfs_super.jnl_blks[i];
+        lo = LXHFS_BLKS_SZ(jblk->blkno) > offset ? LXHFS_BLKS_SZ(jblk->blkno) : offset;
+        hi = LXHFS_BLKS_SZ(jblk->blkno + 1) < offset + size ? LXHFS_BLKS_SZ(jblk->blkno + 1) : offset + size;
+        if (lo < hi)
+        {
+            memcpy(out_content + (lo - offset), jblk->data + (lo - LXHFS_BLKS_SZ(jblk->blkno)), hi - lo);
+        }
+    }
+}
+
+/**
+ * @brief 元数据块被释放(目录块变为空闲)。丢掉它的记录，免得检查点写回；
+ *        日志中已有它的旧镜像时，在下一个事务里写撤销记录，免得重放时覆盖新的用途
+ *
+ * @param blkno
+ */
+void lxhfs_journal_revoke(uint64_t blkno)
+{
+    int i = lxhfs_journal_find(blkno);
+    if (i < 0)
+    {
+        return;
+    }
+    if (lxhfs_super.jnl_blks[i].ckpt != NULL)
+    {
+        lxhfs_super.jnl_revoke = (uint64_t *)realloc(lxhfs_super.jnl_revoke,
+                                                     (lxhfs_super.jnl_revoke_cnt + 1) * sizeof(uint64_t));
+        lxhfs_super.jnl_revoke[lxhfs_super.jnl_revoke_cnt++] = blkno;
+    }
+    lxhfs_journal_remove(i);
+}
+
+/**
+ * @brief 检查点：把已提交的元数据写回原位并落盘，然后清空日志区。
+ *        运行中事务里的修改保留，等待提交
+ *
+ * @return int
+ */
+int lxhfs_journal_checkpoint()
+{
+    struct lxhfs_jblk *jblk;
+    int i;
+    if (lxhfs_super.journal_blks == 0 || lxhfs_super.jnl_head == 1)
+    { /* 上次检查点以来没有提交过事务 */
+        return LXHFS_ERROR_NONE;
+    }
+    for (i = 0; i < lxhfs_super.jnl_cnt; i++)
+    {
+        jblk = &lxhfs_super.jnl_blks[i];
+        if (jblk->ckpt != NULL &&
+            lxhfs_driver_write(LXHFS_BLKS_SZ(jblk->blkno), jblk->ckpt, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    if (lxhfs_buf_flush(-1) != LXHFS_ERROR_NONE ||
+        ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    /*原位已落盘，日志中的事务都不再需要*/
+    if (lxhfs_journal_reset(lxhfs_super.jnl_seq) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    for (i = 0; i < lxhfs_super.jnl_cnt;)
+    {
+        jblk = &lxhfs_super.jnl_blks[i];
+        if (!jblk->dirty)
+        {
+            lxhfs_journal_remove(i);
+            continue;
+        }
+        free(jblk->ckpt);
+        jblk->ckpt = NULL;
+        i++;
+    }
+    lxhfs_super.jnl_revoke_cnt = 0;
+    lxhfs_super.jnl_checkpoints++;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 提交运行中的事务。描述块和块镜像连续写入日志区后落盘，再以FUA写提交块。
+ *        两次写回之间所有操作的元数据修改合并为一个事务(组提交)；
+ *        日志区空间不足时先做检查点
+ *
+ * @return int
+ */
+int lxhfs_journal_commit()
+{
+    struct lxhfs_jnl_d *desc, *commit;
+    struct lxhfs_jblk *jblk;
+    uint8_t *log;
+    uint32_t csum = 0;
+    int nr = 0, i, k, ret = LXHFS_ERROR_NONE;
+
+    if (lxhfs_super.journal_blks == 0)
+    {
+        return ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0 ? -LXHFS_ERROR_IO : LXHFS_ERROR_NONE;
+    }
+    for (i = 0; i < lxhfs_super.jnl_cnt; i++)
+    {
+        nr += lxhfs_super.jnl_blks[i].dirty;
+    }
+    if (nr == 0 && lxhfs_super.jnl_revoke_cnt == 0)
+    { /* 只有数据块，落盘即可 */
+        return ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0 ? -LXHFS_ERROR_IO : LXHFS_ERROR_NONE;
+    }
+
+    /*描述块+镜像+提交块放不下时，先检查点腾出日志区*/
+    if (lxhfs_super.jnl_head + nr + 2 > lxhfs_super.journal_blks &&
+        lxhfs_journal_checkpoint() != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    if (nr + 3 > lxhfs_super.journal_blks || nr + lxhfs_super.jnl_revoke_cnt > LXHFS_JNL_DESC_CAP())
+    { /* 整个日志区也放不下，清空日志区后直接写回原位，失去原子性。
+         日志区中没有事务时检查点什么也不做，不能交给检查点写 */
+        LXHFS_DBG("[%s] transaction of %d blocks exceeds the journal, writing in place\n", __func__, nr);
+        if (lxhfs_journal_checkpoint() != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        while (lxhfs_super.jnl_cnt > 0)
+        {
+            jblk = &lxhfs_super.jnl_blks[lxhfs_super.jnl_cnt - 1];
+            if (jblk->dirty &&
+                lxhfs_driver_write(LXHFS_BLKS_SZ(jblk->blkno), jblk->data, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+            {
+                return -LXHFS_ERROR_IO;
+            }
+            lxhfs_journal_remove(lxhfs_super.jnl_cnt - 1);
+        }
+        lxhfs_super.jnl_revoke_cnt = 0;
+        return lxhfs_buf_flush(-1) != LXHFS_ERROR_NONE || ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0
+                   ? -LXHFS_ERROR_IO
+                   : LXHFS_ERROR_NONE;
+    }
+
+    /*描述块和镜像在日志区中连续，一次写下*/
+    log = (uint8_t *)calloc(nr + 1, LXHFS_BLK_SZ());
+    desc = (struct lxhfs_jnl_d *)log;
+    desc->magic = LXHFS_JNL_MAGIC;
+    desc->type = LXHFS_JNL_DESC;
+    desc->seq = lxhfs_super.jnl_seq;
+    desc->nr = nr;
+    desc->nr_revoke = lxhfs_super.jnl_revoke_cnt;
+    for (i = 0, k = 0; i < lxhfs_super.jnl_cnt; i++)
+    {
+        jblk = &lxhfs_super.jnl_blks[i];
+        if (!jblk->dirty)
+        {
+            continue;
+        }
+        desc->blkno[k] = jblk->blkno;
+        memcpy(log + LXHFS_BLKS_SZ(k + 1), jblk->data, LXHFS_BLK_SZ());
+        csum = lxhfs_journal_csum(jblk->data, LXHFS_BLK_SZ(), csum);
+        k++;
+    }
+    memcpy(&desc->blkno[nr], lxhfs_super.jnl_revoke, lxhfs_super.jnl_revoke_cnt * sizeof(uint64_t));
+    if (lxhfs_journal_io(lxhfs_super.jnl_head, log, nr + 1, TRUE, 0) != LXHFS_ERROR_NONE ||
+        ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0)
+    {
+        free(log);
+        return -LXHFS_ERROR_IO;
+    }
+
+    /*镜像(以及此前写下的数据块)落盘后才写提交块*/
+    memset(log, 0, LXHFS_BLK_SZ());
+    commit = (struct lxhfs_jnl_d *)log;
+    commit->magic = LXHFS_JNL_MAGIC;
+    commit->type = LXHFS_JNL_COMMIT;
+    commit->seq = lxhfs_super.jnl_seq;
+    commit->nr = nr;
+    commit->csum = csum;
+    ret = lxhfs_journal_io(lxhfs_super.jnl_head + nr + 1, log, 1, TRUE, DDRIVER_RWF_FUA);
+    free(log);
+    if (ret != LXHFS_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    /*提交后的内容成为检查点时要写回的内容*/
+    for (i = 0; i < lxhfs_super.jnl_cnt; i++)
+    {
+        jblk = &lxhfs_super.jnl_blks[i];
+        if (!jblk->dirty)
+        {
+            continue;
+        }
+        if (jblk->ckpt == NULL)
+        {
+            jblk->ckpt = (uint8_t *)malloc(LXHFS_BLK_SZ());
+        }
+        memcpy(jblk->ckpt, jblk->data, LXHFS_BLK_SZ());
+        jblk->dirty = FALSE;
+    }
+    lxhfs_super.jnl_head += nr + 2;
+    lxhfs_super.jnl_seq++;
+    lxhfs_super.jnl_revoke_cnt = 0;
+    lxhfs_super.jnl_commits++;
+    lxhfs_super.jnl_logged += nr;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 挂载时重放日志：从日志超级块记录的序号起，依次校验完整提交的事务，
+ *        把其中未被撤销的块镜像写回原位，落盘后清空日志区
+ *
+ * @param journal_offset
+ * @param journal_blks
+ * @return int 重放的事务数，出错返回负值
+ */
+int lxhfs_journal_replay(uint64_t journal_offset, int journal_blks)
+{
+    struct lxhfs_jnl_d *jsb, *desc, *commit;
+    uint8_t *log = (uint8_t *)malloc(LXHFS_BLKS_SZ(journal_blks));
+    uint64_t seq, *revoke_blk = NULL, *revoke_seq = NULL, tx_seq;
+    int revoke_cnt = 0, head, tx_cnt = 0, tx, i, j, pass;
+    uint32_t csum;
+    boolean revoked;
+
+    lxhfs_super.journal_offset = journal_offset;
+    lxhfs_super.journal_blks = journal_blks;
+    lxhfs_super.jnl_cnt = lxhfs_super.jnl_revoke_cnt = 0;
+    /*先只读日志超级块和第一个描述块，正常卸载后日志为空，不必读整个日志区*/
+    if (lxhfs_journal_io(0, log, 2, FALSE, 0) != LXHFS_ERROR_NONE)
+    {
+        free(log);
+        return -LXHFS_ERROR_IO;
+    }
+    jsb = (struct lxhfs_jnl_d *)log;
+    desc = (struct lxhfs_jnl_d *)(log + LXHFS_BLK_SZ());
+    if (jsb->magic != LXHFS_JNL_MAGIC || jsb->type != LXHFS_JNL_SUPER)
+    { /* 新建的日志区 */
+        free(log);
+        return lxhfs_journal_reset(1) == LXHFS_ERROR_NONE ? 0 : -LXHFS_ERROR_IO;
+    }
+    if (desc->magic != LXHFS_JNL_MAGIC || desc->type != LXHFS_JNL_DESC || desc->seq != jsb->seq)
+    {
+        lxhfs_super.jnl_seq = jsb->seq;
+        lxhfs_super.jnl_head = 1;
+        free(log);
+        return 0;
+    }
+    if (lxhfs_journal_io(2, log + LXHFS_BLKS_SZ(2), journal_blks - 2, FALSE, 0) != LXHFS_ERROR_NONE)
+    {
+        free(log);
+        return -LXHFS_ERROR_IO;
+    }
+
+    /*第一遍找出完整的事务和撤销记录，第二遍写回镜像*/
+    for (pass = 0; pass < 2; pass++)
+    {
+        seq = jsb->seq;
+        head = 1;
+        for (tx = 0; pass == 1 ? tx < tx_cnt : TRUE; tx++)
+        {
+            desc = (struct lxhfs_jnl_d *)(log + LXHFS_BLKS_SZ(head));
+            if (head + 2 > journal_blks || desc->magic != LXHFS_JNL_MAGIC || desc->type != LXHFS_JNL_DESC ||
+                desc->seq != seq || head + desc->nr + 2 > journal_blks ||
+                desc->nr + desc->nr_revoke > LXHFS_JNL_DESC_CAP())
+            {
+                break;
+            }
+            commit = (struct lxhfs_jnl_d *)(log + LXHFS_BLKS_SZ(head + desc->nr + 1));
+            csum = 0;
+            for (i = 0; i < desc->nr; i++)
+            {
+                csum = lxhfs_journal_csum(log + LXHFS_BLKS_SZ(head + 1 + i), LXHFS_BLK_SZ(), csum);
+            }
+            if (commit->magic != LXHFS_JNL_MAGIC || commit->type != LXHFS_JNL_COMMIT ||
+                commit->seq != seq || commit->nr != desc->nr || commit->csum != csum)
+            { /* 提交块没写完，事务不生效 */
+                break;
+            }
+            if (pass == 0)
+            {
+                revoke_blk = (uint64_t *)realloc(revoke_blk, (revoke_cnt + desc->nr_revoke + 1) * sizeof(uint64_t));
+                revoke_seq = (uint64_t *)realloc(revoke_seq, (revoke_cnt + desc->nr_revoke + 1) * sizeof(uint64_t));
+                for (i = 0; i < desc->nr_revoke; i++)
+                {
+                    revoke_blk[revoke_cnt] = desc->blkno[desc->nr + i];
+                    revoke_seq[revoke_cnt++] = seq;
+                }
+                tx_cnt++;
+            }
+            else
+            {
+                tx_seq = seq;
+                for (i = 0; i < desc->nr; i++)
+                {
+                    /*之后的事务里撤销过的块已另作他用*/
+                    revoked = FALSE;
+                    for (j = 0; j < revoke_cnt; j++)
+                    {
+                        revoked |= revoke_blk[j] == desc->blkno[i] && revoke_seq[j] > tx_seq;
+                    }
+                    if (!revoked &&
+                        lxhfs_driver_write(LXHFS_BLKS_SZ(desc->blkno[i]), log + LXHFS_BLKS_SZ(head + 1 + i),
+                                           LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+                    {
+                        free(log);
+                        free(revoke_blk);
+                        free(revoke_seq);
+                        return -LXHFS_ERROR_IO;
+                    }
+                }
+            }
+            head += desc->nr + 2;
+            seq++;
+        }
+    }
+    free(log);
+    free(revoke_blk);
+    free(revoke_seq);
+    if (tx_cnt > 0)
+    {
+        LXHFS_DBG("journal: replayed %d transactions\n", tx_cnt);
+        if (lxhfs_buf_flush(-1) != LXHFS_ERROR_NONE ||
+            ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    return lxhfs_journal_reset(seq) == LXHFS_ERROR_NONE ? tx_cnt : -LXHFS_ERROR_IO;
+}
+
+/**
+ * @brief 释放日志的内存结构，调用前需已检查点
+ */
+void lxhfs_journal_destroy()
+{
+    while (lxhfs_super.jnl_cnt > 0)
+    {
+        lxhfs_journal_remove(lxhfs_super.jnl_cnt - 1);
+    }
+    free(lxhfs_super.jnl_blks);
+    free(lxhfs_super.jnl_revoke);
+    lxhfs_super.jnl_blks = NULL;
+    lxhfs_super.jnl_revoke = NULL;
+    lxhfs_super.jnl_cap = lxhfs_super.jnl_revoke_cnt = 0;
+}
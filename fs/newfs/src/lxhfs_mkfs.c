@@ -0,0 +1,195 @@
+#include "../include/lxhfs.h"
+
+/*
+ * 格式化只依赖驱动和磁盘结构，不使用内存超级块，挂载和独立的mkfs.lxhfs共用
+ */
+
+/**
+ * @brief 由设备大小计算布局：日志区之后依次是若干块组，每个块组是inode片加数据片，
+ *        各块组的位图合在一起放在Inode Map和DATA Map中，描述符表紧随其后
+ *
+ * @param super_d 填写除sz_usage外的全部字段
+ * @param sz_disk 设备大小
+ * @param sz_blk 逻辑块大小，需为IO单位的整数倍且能放下整数个inode
+ * @param inode_ratio 每多少字节配一个inode
+ * @param group_blks 每个块组的块数，超过一个位图块能描述的块数时取后者
+ * @return int
+ */
+int lxhfs_mkfs_layout(struct lxhfs_super_d *super_d, uint64_t sz_disk, int sz_blk, int inode_ratio, int group_blks)
+{
+    int64_t blks = sz_disk / sz_blk;
+    int64_t bits_per_blk = (int64_t)sz_blk * UINT8_BITS;
+    int64_t rest, last, max_ino, max_data;
+    int ino_per_blk = sz_blk / LXHFS_INODE_SZ;
+    int inode_num = (int)(sz_disk / inode_ratio);
+    int map_inode_blks = 1, map_data_blks = 1, desc_blks = 1;
+    int group_cnt, group_inodes, group_data, inode_blks, i;
+
+    if (sz_blk < LXHFS_INODE_SZ || sz_blk % LXHFS_INODE_SZ != 0 || inode_ratio < sz_blk)
+    {
+        LXHFS_DBG("[%s] bad block size %d or inode ratio %d\n", __func__, sz_blk, inode_ratio);
+        return -LXHFS_ERROR_INVAL;
+    }
+    if (group_blks <= 0 || group_blks > bits_per_blk)
+    {
+        group_blks = (int)bits_per_blk;
+    }
+
+    /*位图和描述符表的大小取决于块组的划分，反过来又影响剩下的空间，迭代到不再变化*/
+    for (i = 0; i < 4; i++)
+    {
+        rest = blks - 1 - map_inode_blks - map_data_blks - desc_blks - LXHFS_JOURNAL_BLKS;
+        group_cnt = (int)((rest + group_blks - 1) / group_blks);
+        if (group_cnt <= 0)
+        {
+            LXHFS_DBG("[%s] device too small\n", __func__);
+            return -LXHFS_ERROR_NOSPACE;
+        }
+        /*inode平均分到各块组，取整到整块，inode片中不留空位*/
+        group_inodes = (inode_num + group_cnt - 1) / group_cnt;
+        group_inodes = (group_inodes + ino_per_blk - 1) / ino_per_blk * ino_per_blk;
+        if (group_inodes < ino_per_blk)
+        {
+            group_inodes = ino_per_blk;
+        }
+        inode_blks = group_inodes / ino_per_blk;
+        if (inode_blks >= group_blks)
+        {
+            LXHFS_DBG("[%s] inode ratio %d too small for %d-block groups\n", __func__, inode_ratio, group_blks);
+            return -LXHFS_ERROR_INVAL;
+        }
+        group_data = group_blks - inode_blks;
+        /*最后一个块组可能不满，连inode片都放不下时就不要了*/
+        last = rest - (int64_t)(group_cnt - 1) * group_blks - inode_blks;
+        if (last <= 0)
+        {
+            group_cnt--;
+            last = group_data;
+        }
+        if (group_cnt <= 0)
+        {
+            LXHFS_DBG("[%s] device too small\n", __func__);
+            return -LXHFS_ERROR_NOSPACE;
+        }
+        max_ino = (int64_t)group_cnt * group_inodes;
+        max_data = (int64_t)(group_cnt - 1) * group_data + last;
+        if (map_inode_blks == (max_ino + bits_per_blk - 1) / bits_per_blk &&
+            map_data_blks == (max_data + bits_per_blk - 1) / bits_per_blk &&
+            desc_blks == (group_cnt * (int)sizeof(struct lxhfs_group_d) + sz_blk - 1) / sz_blk)
+        {
+            break;
+        }
+        map_inode_blks = (int)((max_ino + bits_per_blk - 1) / bits_per_blk);
+        map_data_blks = (int)((max_data + bits_per_blk - 1) / bits_per_blk);
+        desc_blks = (group_cnt * (int)sizeof(struct lxhfs_group_d) + sz_blk - 1) / sz_blk;
+    }
+
+    memset(super_d, 0, sizeof(struct lxhfs_super_d));
+    super_d->magic_num = LXHFS_MAGIC_NUM;
+    super_d->sz_blk = sz_blk;
+    super_d->max_ino = (uint32_t)max_ino;
+    super_d->max_data = (uint32_t)max_data;
+    super_d->map_inode_blks = map_inode_blks;
+    super_d->map_data_blks = map_data_blks;
+    super_d->group_desc_blks = desc_blks;
+    super_d->group_cnt = group_cnt;
+    super_d->group_inodes = group_inodes;
+    super_d->group_data = group_data;
+    super_d->map_inode_offset = LXHFS_SUPER_OFS + (uint64_t)sz_blk;
+    super_d->map_data_offset = super_d->map_inode_offset + (uint64_t)map_inode_blks * sz_blk;
+    super_d->group_desc_offset = super_d->map_data_offset + (uint64_t)map_data_blks * sz_blk;
+    super_d->journal_offset = super_d->group_desc_offset + (uint64_t)desc_blks * sz_blk;
+    super_d->journal_blks = LXHFS_JOURNAL_BLKS;
+    super_d->inode_offset = super_d->journal_offset + (uint64_t)LXHFS_JOURNAL_BLKS * sz_blk;
+    super_d->sz_inode = LXHFS_INODE_SZ; /* 多个inode紧密存放在一个块中 */
+    super_d->inode_blks = inode_blks;
+    super_d->data_offset = super_d->inode_offset + (uint64_t)inode_blks * sz_blk;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把落在当前分段[base, base + size)内的一段元数据放进分段缓冲区
+ *
+ * @param chunk
+ * @param base 分段的磁盘偏移
+ * @param size 分段大小
+ * @param offset 元数据的磁盘偏移
+ * @param content
+ * @param len
+ */
+static void lxhfs_mkfs_place(uint8_t *chunk, uint64_t base, int size, uint64_t offset, void *content, int len)
+{
+    if (offset >= base && offset + len <= base + size)
+    {
+        memcpy(chunk + (offset - base), content, len);
+    }
+}
+
+/**
+ * @brief 写出空文件系统：超级块、位图、描述符表、日志区和第0个块组的inode片按偏移顺序
+ *        拼成大段依次写出，其后的块组整体丢弃，读出即为0。根目录是内嵌的空目录，只占inode 0
+ *
+ * @param fd 已打开的驱动
+ * @param super_d lxhfs_mkfs_layout算好的布局
+ * @return int
+ */
+int lxhfs_mkfs(int fd, struct lxhfs_super_d *super_d)
+{
+    int sz_blk = super_d->sz_blk;
+    int meta_blks = (int)(super_d->data_offset / sz_blk);
+    int chunk_sz = LXHFS_MKFS_CHUNK_BLKS * sz_blk;
+    uint8_t *chunk = (uint8_t *)malloc(chunk_sz);
+    uint8_t root_map = 0x1;
+    struct lxhfs_jnl_d jsb;
+    struct lxhfs_inode_d root_d;
+    struct lxhfs_group_d group_d;
+    struct ddriver_range discard;
+    uint64_t base, stride = (uint64_t)(super_d->inode_blks + super_d->group_data) * sz_blk;
+    int blk, size, g;
+
+    memset(&jsb, 0, sizeof(jsb));
+    jsb.magic = LXHFS_JNL_MAGIC;
+    jsb.type = LXHFS_JNL_SUPER;
+    jsb.seq = 1;
+
+    memset(&root_d, 0, sizeof(root_d));
+    root_d.ino = LXHFS_ROOT_INO;
+    root_d.ftype = LXHFS_DIR;
+    root_d.flags = LXHFS_INODE_INLINE;
+
+    for (blk = 0; blk < meta_blks; blk += LXHFS_MKFS_CHUNK_BLKS)
+    {
+        base = (uint64_t)blk * sz_blk;
+        size = meta_blks - blk < LXHFS_MKFS_CHUNK_BLKS ? (meta_blks - blk) * sz_blk : chunk_sz;
+        memset(chunk, 0, size);
+        lxhfs_mkfs_place(chunk, base, size, LXHFS_SUPER_OFS, super_d, sizeof(struct lxhfs_super_d));
+        lxhfs_mkfs_place(chunk, base, size, super_d->map_inode_offset, &root_map, sizeof(root_map));
+        for (g = 0; g < super_d->group_cnt; g++)
+        {
+            group_d.free_inodes = super_d->group_inodes - (g == 0);
+            group_d.free_data = g < super_d->group_cnt - 1 ? super_d->group_data
+                                                          : super_d->max_data - g * super_d->group_data;
+            group_d.dirs = g == 0; /* 根目录 */
+            group_d.pad = 0;
+            lxhfs_mkfs_place(chunk, base, size, super_d->group_desc_offset + g * sizeof(group_d),
+                             &group_d, sizeof(group_d));
+        }
+        lxhfs_mkfs_place(chunk, base, size, super_d->journal_offset, &jsb, sizeof(jsb));
+        lxhfs_mkfs_place(chunk, base, size, super_d->inode_offset + LXHFS_ROOT_INO * super_d->sz_inode,
+                         &root_d, sizeof(root_d));
+        if (ddriver_pwrite(fd, (char *)chunk, size, base) != size)
+        {
+            LXHFS_DBG("[%s] io error\n", __func__);
+            free(chunk);
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    free(chunk);
+
+    /*其余的inode片和数据片不需要清零，丢弃掉旧内容即可*/
+    discard.offset = super_d->data_offset;
+    discard.size = (uint64_t)(super_d->group_cnt - 1) * stride +
+                   (uint64_t)(super_d->max_data - (super_d->group_cnt - 1) * super_d->group_data) * sz_blk;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_DISCARD, &discard);
+    return ddriver_ioctl(fd, IOC_REQ_FLUSH, NULL) < 0 ? -LXHFS_ERROR_IO : LXHFS_ERROR_NONE;
+}
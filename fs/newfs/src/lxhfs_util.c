@@ -45,6 +45,452 @@ int lxhfs_calc_lvl(const char *path)
     return lvl;
 }
 
+/**
+ * @brief 把排队中与[offset, offset + size)重叠的写请求覆盖到buf上
+ *
+ * @param offset 和块对齐
+ * @param buf
+ * @param size
+ */
+void lxhfs_plug_overlay(uint64_t offset, uint8_t *buf, int size)
+{
+    struct ddriver_io *io;
+    uint64_t start, end;
+    int i;
+    for (i = 0; i < lxhfs_super.plug_cnt; i++)
+    {
+        io = &lxhfs_super.plug_ios[i];
+        start = (uint64_t)io->offset > offset ? (uint64_t)io->offset : offset;
+        end = io->offset + io->size < offset + size ? io->offset + io->size : offset + size;
+        if (start < end)
+        {
+            memcpy(buf + (start - offset), io->buf + (start - io->offset), end - start);
+        }
+    }
+}
+
+/**
+ * @brief 写请求入队，同一位置的写直接合并进已有的Buf
+ *
+ * @param offset 和块对齐
+ * @param buf 由队列接管并释放
+ * @param size
+ */
+void lxhfs_plug_add(uint64_t offset, uint8_t *buf, int size)
+{
+    struct ddriver_io *io;
+    int i;
+    for (i = 0; i < lxhfs_super.plug_cnt; i++)
+    {
+        io = &lxhfs_super.plug_ios[i];
+        if ((uint64_t)io->offset == offset && io->size == (size_t)size)
+        {
+            memcpy(io->buf, buf, size);
+            free(buf);
+            return;
+        }
+    }
+    if (lxhfs_super.plug_cnt == lxhfs_super.plug_cap)
+    {
+        lxhfs_super.plug_cap = lxhfs_super.plug_cap ? 2 * lxhfs_super.plug_cap : 64;
+        lxhfs_super.plug_ios = (struct ddriver_io *)realloc(lxhfs_super.plug_ios,
+                                                            lxhfs_super.plug_cap * sizeof(struct ddriver_io));
+    }
+    io = &lxhfs_super.plug_ios[lxhfs_super.plug_cnt++];
+    io->opcode = DDRIVER_OP_WRITE;
+    io->flags = 0;
+    io->buf = (char *)buf;
+    io->size = size;
+    io->offset = offset;
+}
+
+/**
+ * @brief 之后的写请求只排队不下发
+ */
+void lxhfs_plug()
+{
+    lxhfs_super.is_plugged = TRUE;
+}
+
+/**
+ * @brief 把排队的写请求一次交给驱动，由电梯调度排序合并后一趟扫描写完
+ *
+ * @return int
+ */
+int lxhfs_unplug()
+{
+    int i, ret = LXHFS_ERROR_NONE;
+    lxhfs_super.is_plugged = FALSE;
+    if (lxhfs_super.plug_cnt > 0 &&
+        ddriver_dispatch(LXHFS_DRIVER(), lxhfs_super.plug_ios, lxhfs_super.plug_cnt) != lxhfs_super.plug_cnt)
+    {
+        ret = -LXHFS_ERROR_IO;
+    }
+    for (i = 0; i < lxhfs_super.plug_cnt; i++)
+    {
+        free(lxhfs_super.plug_ios[i].buf);
+    }
+    lxhfs_super.plug_cnt = 0;
+    return ret;
+}
+
+/**
+ * @brief 把连续的块写往设备，plug期间复制一份排队
+ *
+ * @param offset 和块对齐
+ * @param buf
+ * @param size
+ * @return int
+ */
+int lxhfs_buf_writeout(uint64_t offset, uint8_t *buf, int size)
+{
+    uint8_t *copy;
+    lxhfs_super.buf_writeback += size / LXHFS_BLK_SZ();
+    if (lxhfs_super.is_plugged)
+    {
+        copy = (uint8_t *)malloc(size);
+        memcpy(copy, buf, size);
+        lxhfs_plug_add(offset, copy, size);
+        return LXHFS_ERROR_NONE;
+    }
+    if (ddriver_pwrite(LXHFS_DRIVER(), (char *)buf, size, offset) != size)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 初始化块缓存
+ *
+ * @param blks 缓存块数，0为不缓存
+ * @return int
+ */
+int lxhfs_buf_init(int blks)
+{
+    int i;
+    lxhfs_super.buf_cnt = blks;
+    lxhfs_super.buf_hand = 0;
+    lxhfs_super.buf_hit = lxhfs_super.buf_miss = 0;
+    lxhfs_super.buf_evict = lxhfs_super.buf_writeback = 0;
+    lxhfs_super.buf_dirty = 0;
+    if (blks <= 0)
+    {
+        lxhfs_super.buf_cnt = 0;
+        return LXHFS_ERROR_NONE;
+    }
+    for (lxhfs_super.buf_hash_sz = 1; lxhfs_super.buf_hash_sz < blks; lxhfs_super.buf_hash_sz <<= 1)
+        ;
+    lxhfs_super.bufs = (struct lxhfs_buf *)calloc(blks, sizeof(struct lxhfs_buf));
+    lxhfs_super.buf_hash = (struct lxhfs_buf **)calloc(lxhfs_super.buf_hash_sz, sizeof(struct lxhfs_buf *));
+    if (lxhfs_super.bufs == NULL || lxhfs_super.buf_hash == NULL)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < blks; i++)
+    {
+        lxhfs_super.bufs[i].data = (uint8_t *)malloc(LXHFS_BLK_SZ());
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放块缓存，调用前需已flush
+ */
+void lxhfs_buf_destroy()
+{
+    int i;
+    for (i = 0; i < lxhfs_super.buf_cnt; i++)
+    {
+        free(lxhfs_super.bufs[i].data);
+    }
+    free(lxhfs_super.bufs);
+    free(lxhfs_super.buf_hash);
+    lxhfs_super.bufs = NULL;
+    lxhfs_super.buf_hash = NULL;
+    lxhfs_super.buf_cnt = 0;
+}
+
+/**
+ * @brief 在块缓存中查找一个块
+ *
+ * @param blkno
+ * @return struct lxhfs_buf* 未缓存返回NULL
+ */
+struct lxhfs_buf *lxhfs_buf_lookup(uint64_t blkno)
+{
+    struct lxhfs_buf *buf = lxhfs_super.buf_hash[blkno & (lxhfs_super.buf_hash_sz - 1)];
+    while (buf != NULL && buf->blkno != blkno)
+    {
+        buf = buf->hnext;
+    }
+    return buf;
+}
+
+/**
+ * @brief 把缓存块从哈希桶中摘下，脏块不写回
+ *
+ * @param buf
+ */
+void lxhfs_buf_unhash(struct lxhfs_buf *buf)
+{
+    struct lxhfs_buf **pprev = &lxhfs_super.buf_hash[buf->blkno & (lxhfs_super.buf_hash_sz - 1)];
+    while (*pprev != buf)
+    {
+        pprev = &(*pprev)->hnext;
+    }
+    *pprev = buf->hnext;
+    buf->hnext = NULL;
+    if (buf->flags & LXHFS_FLAG_BUF_DIRTY)
+    {
+        lxhfs_super.buf_dirty--;
+    }
+    buf->flags = 0;
+}
+
+/**
+ * @brief 为blkno取一个缓存块，不读设备。没有空闲块时按CLOCK淘汰，脏块先写回
+ *
+ * @param blkno
+ * @return struct lxhfs_buf* 淘汰时写回失败返回NULL
+ */
+struct lxhfs_buf *lxhfs_buf_get(uint64_t blkno)
+{
+    struct lxhfs_buf *buf = lxhfs_buf_lookup(blkno);
+    int bucket;
+    if (buf != NULL)
+    {
+        return buf;
+    }
+    while (TRUE)
+    {
+        buf = &lxhfs_super.bufs[lxhfs_super.buf_hand];
+        lxhfs_super.buf_hand = (lxhfs_super.buf_hand + 1) % lxhfs_super.buf_cnt;
+        if (!(buf->flags & LXHFS_FLAG_BUF_OCCUPY))
+        {
+            break;
+        }
+        if (buf->ref)
+        { /* 最近用过，给第二次机会 */
+            buf->ref = FALSE;
+            continue;
+        }
+        if ((buf->flags & LXHFS_FLAG_BUF_DIRTY) &&
+            lxhfs_buf_writeout(LXHFS_BLKS_SZ(buf->blkno), buf->data, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+        {
+            return NULL;
+        }
+        lxhfs_buf_unhash(buf);
+        lxhfs_super.buf_evict++;
+        break;
+    }
+    bucket = blkno & (lxhfs_super.buf_hash_sz - 1);
+    buf->blkno = blkno;
+    buf->flags = LXHFS_FLAG_BUF_OCCUPY;
+    buf->ref = TRUE;
+    buf->hnext = lxhfs_super.buf_hash[bucket];
+    lxhfs_super.buf_hash[bucket] = buf;
+    return buf;
+}
+
+/**
+ * @brief 经块缓存读连续的块，连续未命中的块合并为一次设备读
+ *
+ * @param offset 和块对齐
+ * @param out_content
+ * @param size 块大小的整数倍
+ * @return int
+ */
+int lxhfs_buf_read(uint64_t offset, uint8_t *out_content, int size)
+{
+    uint64_t blkno = LXHFS_BUF_BLKNO(offset);
+    int blks = size / LXHFS_BLK_SZ();
+    struct lxhfs_buf *buf;
+    int i, j;
+    for (i = 0; i < blks; i = j)
+    {
+        buf = lxhfs_buf_lookup(blkno + i);
+        if (buf != NULL)
+        {
+            memcpy(out_content + LXHFS_BLKS_SZ(i), buf->data, LXHFS_BLK_SZ());
+            buf->ref = TRUE;
+            lxhfs_super.buf_hit++;
+            j = i + 1;
+            continue;
+        }
+        for (j = i + 1; j < blks && lxhfs_buf_lookup(blkno + j) == NULL; j++)
+            ;
+        if (ddriver_pread(LXHFS_DRIVER(), (char *)out_content + LXHFS_BLKS_SZ(i), LXHFS_BLKS_SZ(j - i),
+                          LXHFS_BLKS_SZ(blkno + i)) != LXHFS_BLKS_SZ(j - i))
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        lxhfs_plug_overlay(LXHFS_BLKS_SZ(blkno + i), out_content + LXHFS_BLKS_SZ(i), LXHFS_BLKS_SZ(j - i));
+        lxhfs_super.buf_miss += j - i;
+        if (lxhfs_buf_fill(LXHFS_BLKS_SZ(blkno + i), out_content + LXHFS_BLKS_SZ(i),
+                           LXHFS_BLKS_SZ(j - i)) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief [offset, offset + size)中是否有块已缓存
+ *
+ * @param offset 和块对齐
+ * @param size 块大小的整数倍
+ * @return boolean
+ */
+boolean lxhfs_buf_cached(uint64_t offset, int size)
+{
+    int i;
+    for (i = 0; i < size / LXHFS_BLK_SZ(); i++)
+    {
+        if (lxhfs_buf_lookup(LXHFS_BUF_BLKNO(offset) + i) != NULL)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * @brief 用和设备一致的数据填充缓存，填充的块是干净的
+ *
+ * @param offset 和块对齐
+ * @param content
+ * @param size 块大小的整数倍
+ * @return int
+ */
+int lxhfs_buf_fill(uint64_t offset, uint8_t *content, int size)
+{
+    uint64_t blkno = LXHFS_BUF_BLKNO(offset);
+    struct lxhfs_buf *buf;
+    int i;
+    for (i = 0; i < size / LXHFS_BLK_SZ(); i++)
+    {
+        buf = lxhfs_buf_get(blkno + i);
+        if (buf == NULL)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        memcpy(buf->data, content + LXHFS_BLKS_SZ(i), LXHFS_BLK_SZ());
+        if (buf->flags & LXHFS_FLAG_BUF_DIRTY)
+        {
+            buf->flags &= ~LXHFS_FLAG_BUF_DIRTY;
+            lxhfs_super.buf_dirty--;
+        }
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 经块缓存写连续的块，只改缓存并标脏，淘汰或flush时才写回
+ *
+ * @param offset 和块对齐
+ * @param in_content
+ * @param size 块大小的整数倍
+ * @return int
+ */
+int lxhfs_buf_write(uint64_t offset, uint8_t *in_content, int size)
+{
+    uint64_t blkno = LXHFS_BUF_BLKNO(offset);
+    struct lxhfs_buf *buf;
+    int i;
+    for (i = 0; i < size / LXHFS_BLK_SZ(); i++)
+    {
+        buf = lxhfs_buf_get(blkno + i);
+        if (buf == NULL)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        memcpy(buf->data, in_content + LXHFS_BLKS_SZ(i), LXHFS_BLK_SZ());
+        if (!(buf->flags & LXHFS_FLAG_BUF_DIRTY))
+        {
+            buf->flags |= LXHFS_FLAG_BUF_DIRTY;
+            lxhfs_super.buf_dirty++;
+        }
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 丢弃一个块的缓存，用于已释放的数据块，脏数据不再写回
+ *
+ * @param blkno
+ */
+void lxhfs_buf_drop(uint64_t blkno)
+{
+    struct lxhfs_buf *buf;
+    if (lxhfs_super.buf_cnt == 0 || (buf = lxhfs_buf_lookup(blkno)) == NULL)
+    {
+        return;
+    }
+    lxhfs_buf_unhash(buf);
+}
+
+/**
+ * @brief 按块号比较两个缓存块，供qsort使用
+ */
+int lxhfs_buf_cmp(const void *a, const void *b)
+{
+    uint64_t x = (*(struct lxhfs_buf **)a)->blkno;
+    uint64_t y = (*(struct lxhfs_buf **)b)->blkno;
+    return x < y ? -1 : (x > y);
+}
+
+/**
+ * @brief 按块号顺序写回脏块，相邻的脏块合并为一次写
+ *
+ * @param max_blks 最多写回的块数，小于0时全部写回
+ * @return int
+ */
+int lxhfs_buf_flush(int max_blks)
+{
+    struct lxhfs_buf **dirty;
+    uint8_t *run;
+    int cnt = 0, i, j, k;
+    int ret = LXHFS_ERROR_NONE;
+    if (lxhfs_super.buf_cnt == 0)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    dirty = (struct lxhfs_buf **)malloc(lxhfs_super.buf_cnt * sizeof(struct lxhfs_buf *));
+    for (i = 0; i < lxhfs_super.buf_cnt; i++)
+    {
+        if (lxhfs_super.bufs[i].flags & LXHFS_FLAG_BUF_DIRTY)
+        {
+            dirty[cnt++] = &lxhfs_super.bufs[i];
+        }
+    }
+    qsort(dirty, cnt, sizeof(struct lxhfs_buf *), lxhfs_buf_cmp);
+    if (max_blks >= 0 && cnt > max_blks)
+    { /* 后台刷写每轮只取块号最小的一段，其余留到下一轮 */
+        cnt = max_blks;
+    }
+    for (i = 0; i < cnt; i = j)
+    {
+        for (j = i + 1; j < cnt && dirty[j]->blkno == dirty[i]->blkno + (j - i); j++)
+            ;
+        run = (uint8_t *)malloc(LXHFS_BLKS_SZ(j - i));
+        for (k = i; k < j; k++)
+        {
+            memcpy(run + LXHFS_BLKS_SZ(k - i), dirty[k]->data, LXHFS_BLK_SZ());
+            dirty[k]->flags &= ~LXHFS_FLAG_BUF_DIRTY;
+        }
+        lxhfs_super.buf_dirty -= j - i;
+        if (lxhfs_buf_writeout(LXHFS_BLKS_SZ(dirty[i]->blkno), run, LXHFS_BLKS_SZ(j - i)) != LXHFS_ERROR_NONE)
+        {
+            ret = -LXHFS_ERROR_IO;
+        }
+        free(run);
+    }
+    free(dirty);
+    return ret;
+}
+
 /**
  * @brief 驱动读
  *
@@ -53,271 +499,1565 @@ int lxhfs_calc_lvl(const char *path)
  * @param size
  * @return int
  */
-int lxhfs_driver_read(int offset, uint8_t *out_content, int size)
+int lxhfs_driver_read(uint64_t offset, uint8_t *out_content, int size)
+{
+    uint64_t offset_aligned = LXHFS_ROUND_DOWN(offset, LXHFS_BLK_SZ());
+    int bias = offset - offset_aligned;
+    int size_aligned = LXHFS_ROUND_UP((size + bias), LXHFS_BLK_SZ());
+    uint8_t *mapped;
+    if (lxhfs_options.use_mmap)
+    { /* mmap模式：直接从映射的镜像拷出，不经过中间Buf */
+        mapped = (uint8_t *)ddriver_map(LXHFS_DRIVER(), offset_aligned, size_aligned, DDRIVER_MAP_READ);
+        if (mapped == NULL)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        memcpy(out_content, mapped + bias, size);
+        lxhfs_journal_overlay(offset, out_content, size);
+        return LXHFS_ERROR_NONE;
+    }
+    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
+    if (lxhfs_super.buf_cnt > 0)
+    { /* 经块缓存，命中的块不访问设备 */
+        if (lxhfs_buf_read(offset_aligned, temp_content, size_aligned) != LXHFS_ERROR_NONE)
+        {
+            free(temp_content);
+            return -LXHFS_ERROR_IO;
+        }
+        memcpy(out_content, temp_content + bias, size);
+        free(temp_content);
+        lxhfs_journal_overlay(offset, out_content, size);
+        return LXHFS_ERROR_NONE;
+    }
+    // lseek(LXHFS_DRIVER(), offset_aligned, SEEK_SET);
+    /* 连续的IO单位合并为一次定位读请求，不经过共享磁盘头 */
+    if (ddriver_pread(LXHFS_DRIVER(), temp_content, size_aligned, offset_aligned) != size_aligned)
+    {
+        free(temp_content);
+        return -LXHFS_ERROR_IO;
+    }
+    lxhfs_plug_overlay(offset_aligned, temp_content, size_aligned); /* 排队未下发的写比设备上的新 */
+    memcpy(out_content, temp_content + bias, size);
+    free(temp_content);
+    lxhfs_journal_overlay(offset, out_content, size); /* 日志中的元数据比原位上的新 */
+    return LXHFS_ERROR_NONE;
+}
+/**
+ * @brief 驱动写
+ *
+ * @param offset
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int lxhfs_driver_write(uint64_t offset, uint8_t *in_content, int size)
 {
-    int offset_aligned = LXHFS_ROUND_DOWN(offset, LXHFS_BLK_SZ());
+    uint64_t offset_aligned = LXHFS_ROUND_DOWN(offset, LXHFS_BLK_SZ());
     int bias = offset - offset_aligned;
     int size_aligned = LXHFS_ROUND_UP((size + bias), LXHFS_BLK_SZ());
+    uint8_t *mapped;
+    if (lxhfs_options.use_mmap)
+    { /* mmap模式：原地修改映射的镜像再提交，无需先读出整块 */
+        mapped = (uint8_t *)ddriver_map(LXHFS_DRIVER(), offset_aligned, size_aligned, DDRIVER_MAP_WRITE);
+        if (mapped == NULL)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        memcpy(mapped + bias, in_content, size);
+        if (ddriver_commit(LXHFS_DRIVER(), offset_aligned, size_aligned, 0) != size_aligned)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        return LXHFS_ERROR_NONE;
+    }
     uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
+    /* 只有首尾没有被完整覆盖的块需要先读出，中间的整块直接覆盖 */
+    if (bias != 0 &&
+        lxhfs_driver_read(offset_aligned, temp_content, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+    {
+        free(temp_content);
+        return -LXHFS_ERROR_IO;
+    }
+    if ((bias + size) % LXHFS_BLK_SZ() != 0 && (bias == 0 || size_aligned > LXHFS_BLK_SZ()) &&
+        lxhfs_driver_read(offset_aligned + size_aligned - LXHFS_BLK_SZ(),
+                          temp_content + size_aligned - LXHFS_BLK_SZ(), LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+    {
+        free(temp_content);
+        return -LXHFS_ERROR_IO;
+    }
+    memcpy(temp_content + bias, in_content, size);
+
+    if (lxhfs_super.buf_cnt > 0)
+    { /* 写回式缓存：只标脏，淘汰或flush时落盘 */
+        int ret = lxhfs_buf_write(offset_aligned, temp_content, size_aligned);
+        free(temp_content);
+        return ret;
+    }
+
+    if (lxhfs_super.is_plugged)
+    { /* 排队，Buf交给队列 */
+        lxhfs_plug_add(offset_aligned, temp_content, size_aligned);
+        return LXHFS_ERROR_NONE;
+    }
+
     // lseek(LXHFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(LXHFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    /* 连续的IO单位合并为一次定位写请求，不经过共享磁盘头 */
+    if (ddriver_pwrite(LXHFS_DRIVER(), temp_content, size_aligned, offset_aligned) != size_aligned)
+    {
+        free(temp_content);
+        return -LXHFS_ERROR_IO;
+    }
+
+    free(temp_content);
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 驱动批量读写，一次提交全部请求并等待其完成，请求之间的延迟相互重叠
+ *
+ * @param ios 请求描述符，offset和size需与IO单位对齐
+ * @param nr 请求个数
+ * @return int
+ */
+int lxhfs_driver_batch(struct ddriver_io *ios, int nr)
+{
+    struct ddriver_io *done[nr];
+    struct ddriver_io miss[nr];
+    struct ddriver_io *origin = ios;
+    int idx[nr];
+    int submitted = 0, completed = 0, cnt, i;
+    int ret = LXHFS_ERROR_NONE;
+
+    if (lxhfs_super.buf_cnt > 0)
+    { /* 读请求中有块已缓存的经缓存读，只提交完全未命中的；写请求照常提交，完成后刷新缓存 */
+        for (i = 0, cnt = 0; i < nr; i++)
+        {
+            if (ios[i].opcode == DDRIVER_OP_WRITE || !lxhfs_buf_cached(ios[i].offset, ios[i].size))
+            {
+                idx[cnt] = i;
+                miss[cnt++] = ios[i];
+                continue;
+            }
+            ios[i].res = lxhfs_buf_read(ios[i].offset, (uint8_t *)ios[i].buf, ios[i].size) == LXHFS_ERROR_NONE
+                             ? (int)ios[i].size
+                             : -LXHFS_ERROR_IO;
+            if (ios[i].res < 0)
+            {
+                ret = -LXHFS_ERROR_IO;
+            }
+        }
+        ios = miss;
+        nr = cnt;
+    }
+
+    while (completed < nr)
+    {
+        if (submitted < nr)
+        {
+            cnt = ddriver_submit(LXHFS_DRIVER(), ios + submitted, nr - submitted);
+            if (cnt < 0)
+            { /* 提交失败，只等待已提交的请求 */
+                ret = -LXHFS_ERROR_IO;
+                nr = submitted;
+                continue;
+            }
+            submitted += cnt;
+        }
+        cnt = ddriver_reap(LXHFS_DRIVER(), done, 1, nr);
+        for (i = 0; i < cnt; i++)
+        {
+            if (done[i]->res != done[i]->size)
+            {
+                ret = -LXHFS_ERROR_IO;
+            }
+        }
+        completed += cnt;
+    }
+
+    if (origin != ios)
+    {
+        for (i = 0; i < nr; i++)
+        {
+            origin[idx[i]].res = ios[i].res;
+            if (ios[i].res != ios[i].size)
+            {
+                continue;
+            }
+            if (ios[i].opcode == DDRIVER_OP_READ)
+            {
+                lxhfs_super.buf_miss += ios[i].size / LXHFS_BLK_SZ();
+            }
+            lxhfs_buf_fill(ios[i].offset, (uint8_t *)ios[i].buf, ios[i].size);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 单调时钟的当前时间
+ *
+ * @return long 毫秒
+ */
+long lxhfs_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 判断inode是否挂在脏inode链表上
+ */
+boolean lxhfs_inode_listed(struct lxhfs_inode *inode)
+{
+    return inode->dirty_prev != NULL || lxhfs_super.dirty_head == inode;
+}
+
+/**
+ * @brief 标记inode需要写回的部分。第一次变脏时挂到脏inode链表尾，
+ *        超过刷写阈值时唤醒后台刷写线程
+ *
+ * @param inode
+ * @param flags LXHFS_FLAG_INODE_DIRTY / LXHFS_FLAG_DIR_DIRTY
+ * @param blk 需写回的数据块，小于0时没有
+ */
+void lxhfs_mark_dirty(struct lxhfs_inode *inode, flag16 flags, int blk)
+{
+    int bytes = 0;
+    if (!lxhfs_inode_listed(inode))
+    {
+        inode->dirtied_at = lxhfs_now_ms();
+        inode->dirty_next = NULL;
+        inode->dirty_prev = lxhfs_super.dirty_tail;
+        if (lxhfs_super.dirty_tail != NULL)
+        {
+            lxhfs_super.dirty_tail->dirty_next = inode;
+        }
+        else
+        {
+            lxhfs_super.dirty_head = inode;
+        }
+        lxhfs_super.dirty_tail = inode;
+        lxhfs_super.dirty_inodes++;
+    }
+    inode->flags |= flags;
+    if (blk >= 0 && !LXHFS_DATA_IS_DIRTY(inode, blk))
+    {
+        inode->data_dirty[blk / UINT32_BITS] |= 1U << (blk % UINT32_BITS);
+        inode->data_dirty_cnt++;
+    }
+
+    /*重新估计该inode待写回的字节数*/
+    if (inode->flags & LXHFS_FLAG_INODE_DIRTY)
+    {
+        bytes += sizeof(struct lxhfs_inode_d);
+    }
+    if (inode->flags & LXHFS_FLAG_DIR_DIRTY)
+    {
+        bytes += LXHFS_ROUND_UP(inode->dir_cnt, LXHFS_DENTRY_PER_BLK()) / LXHFS_DENTRY_PER_BLK() * LXHFS_BLK_SZ();
+    }
+    bytes += inode->data_dirty_cnt * LXHFS_BLK_SZ();
+    lxhfs_super.dirty_bytes += bytes - inode->dirty_bytes;
+    inode->dirty_bytes = bytes;
+
+    if (lxhfs_super.wb_running &&
+        (lxhfs_super.dirty_bytes >= (uint64_t)lxhfs_super.wb_bytes ||
+         lxhfs_super.dirty_inodes >= lxhfs_super.wb_inodes))
+    {
+        pthread_cond_signal(&lxhfs_super.wb_cond);
+    }
+}
+
+/**
+ * @brief inode已写回或已释放，从脏inode链表摘下
+ *
+ * @param inode
+ */
+void lxhfs_mark_clean(struct lxhfs_inode *inode)
+{
+    if (lxhfs_inode_listed(inode))
+    {
+        if (inode->dirty_prev != NULL)
+        {
+            inode->dirty_prev->dirty_next = inode->dirty_next;
+        }
+        else
+        {
+            lxhfs_super.dirty_head = inode->dirty_next;
+        }
+        if (inode->dirty_next != NULL)
+        {
+            inode->dirty_next->dirty_prev = inode->dirty_prev;
+        }
+        else
+        {
+            lxhfs_super.dirty_tail = inode->dirty_prev;
+        }
+        lxhfs_super.dirty_inodes--;
+    }
+    lxhfs_super.dirty_bytes -= inode->dirty_bytes;
+    inode->dirty_prev = inode->dirty_next = NULL;
+    inode->dirty_bytes = 0;
+    inode->flags = 0;
+    if (inode->blk_cap > 0)
+    {
+        memset(inode->data_dirty, 0, inode->blk_cap / UINT32_BITS * sizeof(uint32_t));
+    }
+    inode->data_dirty_cnt = 0;
+}
+
+/**
+ * @brief 第blk个数据块不再需要写回(已释放)
+ *
+ * @param inode
+ * @param blk
+ */
+void lxhfs_mark_data_clean(struct lxhfs_inode *inode, int blk)
+{
+    if (LXHFS_DATA_IS_DIRTY(inode, blk))
+    {
+        inode->data_dirty[blk / UINT32_BITS] &= ~(1U << (blk % UINT32_BITS));
+        inode->data_dirty_cnt--;
+    }
+}
+
+/**
+ * @brief 读带索引的目录的第blk块
+ *
+ * @param inode
+ * @param blk
+ * @param buf
+ * @return int
+ */
+static int lxhfs_dir_read_blk(struct lxhfs_inode *inode, int blk, uint8_t *buf)
+{
+    if (blk < 0 || blk >= inode->blk_cap || inode->dno[blk] == LXHFS_DNO_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    return lxhfs_driver_read(LXHFS_DATA_OFS(inode->dno[blk]), buf, LXHFS_BLK_SZ());
+}
+
+/**
+ * @brief 带索引的目录只读入了部分目录项时，按文件名哈希顺着索引读入所在的叶块
+ *
+ * @param inode 目录
+ * @param fname
+ * @return int
+ */
+int lxhfs_dir_probe(struct lxhfs_inode *inode, const char *fname)
+{
+    uint32_t hash = lxhfs_dir_hash(fname);
+    uint8_t *blk_buf = (uint8_t *)malloc(LXHFS_BLK_SZ());
+    int blk = 0, levels, ret;
+
+    do
+    {
+        ret = lxhfs_dir_read_blk(inode, blk, blk_buf);
+        levels = ((struct lxhfs_dx_head *)blk_buf)->levels;
+        blk = ret == LXHFS_ERROR_NONE ? lxhfs_dx_next(blk_buf, hash) : -1;
+    } while (blk >= 0 && levels-- > 0);
+
+    ret = lxhfs_dir_read_blk(inode, blk, blk_buf);
+    if (ret == LXHFS_ERROR_NONE)
+    {
+        ret = lxhfs_dir_fill(inode, (struct lxhfs_dentry_d *)blk_buf, LXHFS_DENTRY_PER_BLK());
+    }
+    free(blk_buf);
+    return ret;
+}
+
+/**
+ * @brief 带索引的目录只读入了部分目录项时，读入全部叶块。遍历和增删目录项前调用
+ *
+ * @param inode 目录
+ * @return int
+ */
+int lxhfs_dir_load(struct lxhfs_inode *inode)
+{
+    struct lxhfs_dx_head *head;
+    uint8_t *blk_buf;
+    int index_blks, blk, ret = LXHFS_ERROR_NONE;
+
+    if (!inode->dir_partial)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    /*块的顺序是索引根、下层索引块、叶块，叶块依次排在索引块之后*/
+    blk_buf = (uint8_t *)malloc(LXHFS_BLK_SZ());
+    head = (struct lxhfs_dx_head *)blk_buf;
+    if (lxhfs_dir_read_blk(inode, 0, blk_buf) != LXHFS_ERROR_NONE || head->magic != LXHFS_DX_MAGIC)
+    {
+        free(blk_buf);
+        return -LXHFS_ERROR_IO;
+    }
+    index_blks = head->levels > 0 ? 1 + head->count : 1;
+    for (blk = index_blks; blk < inode->dx_blks && ret == LXHFS_ERROR_NONE; blk++)
+    {
+        ret = lxhfs_dir_read_blk(inode, blk, blk_buf);
+        if (ret == LXHFS_ERROR_NONE)
+        {
+            ret = lxhfs_dir_fill(inode, (struct lxhfs_dentry_d *)blk_buf, LXHFS_DENTRY_PER_BLK());
+        }
+    }
+    free(blk_buf);
+    if (ret == LXHFS_ERROR_NONE)
+    {
+        inode->dir_partial = FALSE;
+    }
+    return ret;
+}
+
+/**
+ * @brief 为一个inode分配dentry，采用头插法
+ *
+ * @param inode
+ * @param dentry
+ * @return int
+ */
+int lxhfs_alloc_dentry(struct lxhfs_inode *inode, struct lxhfs_dentry *dentry)
+{
+    /*写回时按全部目录项重建索引，增删前先全部读入*/
+    if (lxhfs_dir_load(inode) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    if (lxhfs_dir_add(inode, dentry) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    inode->dir_cnt++;
+    lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY | LXHFS_FLAG_DIR_DIRTY, -1);
+    return inode->dir_cnt;
+}
+
+/**
+ * @brief 分配一个inode，占用位图
+ *
+ * @param dentry 该dentry指向分配的inode
+ * @return lxhfs_inode 没有空闲inode时返回NULL
+ */
+struct lxhfs_inode *lxhfs_alloc_inode(struct lxhfs_dentry *dentry)
+{
+    struct lxhfs_inode *inode;
+    int group = lxhfs_group_find(dentry); /*按Orlov选块组，再在块组的inode片中找未使用的inode*/
+    int ino = group < 0 ? group : lxhfs_bitmap_alloc_goal(&lxhfs_super.bm_inode, group * lxhfs_super.group_inodes);
+
+    /*为目录项分配inode节点*/
+    if (ino < 0)
+        return NULL;
+    lxhfs_super.groups[LXHFS_INO_GROUP(ino)].free_inodes--;
+    if (dentry->ftype == LXHFS_DIR)
+    {
+        lxhfs_super.groups[LXHFS_INO_GROUP(ino)].dirs++;
+    }
+    lxhfs_group_touch(LXHFS_INO_GROUP(ino));
+    inode = (struct lxhfs_inode *)malloc(sizeof(struct lxhfs_inode));
+    inode->ino = ino;
+    inode->size = 0;
+    inode->flags = 0;
+    inode->dirty_bytes = 0;
+    inode->dirty_prev = inode->dirty_next = NULL;
+    lxhfs_extent_init(inode); /* 数据块在sync时按需分配，在第一次写入时才分配内存 */
+    lxhfs_super.is_dirty = TRUE;
+
+    /*为目录项分配inode节点并建立他们之间的连接*/
+    /* dentry指向inode */
+    dentry->inode = inode;
+    dentry->ino = inode->ino;
+    /* inode指回dentry */
+    inode->dentry = dentry;
+    inode->dir_cnt = 0;
+    inode->dentrys = NULL;
+    inode->dir_hash = NULL;
+    inode->dir_hash_sz = inode->dir_hash_cnt = 0;
+    inode->dir_partial = FALSE;
+    inode->dx_blks = 0;
+    inode->res_cnt = 0;
+    inode->res_prev = inode->res_next = NULL;
+    inode->rsv_slot = -1;
+    inode->rsv_start = inode->rsv_len = 0;
+    inode->pend_blks = 0;
+    lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY, -1); /* 新inode需写回 */
+
+    return inode;
+}
+
+/**
+ * @brief 记下新占用的[dno, dno + n)：块组空闲数减少，这些块不再需要discard
+ *
+ * @param dno
+ * @param n
+ */
+static void lxhfs_data_taken(int dno, int n)
+{
+    int i;
+    for (i = dno; i < dno + n; i++)
+    {
+        lxhfs_super.groups[LXHFS_DATA_GROUP(i)].free_data--;
+        lxhfs_group_touch(LXHFS_DATA_GROUP(i));
+        lxhfs_super.map_discard[i / UINT8_BITS] &= ~(0x1 << (i % UINT8_BITS));
+    }
+    lxhfs_super.is_dirty = TRUE;
+}
+
+/**
+ * @brief 收回inode的预留窗口
+ *
+ * @param inode
+ */
+static void lxhfs_rsv_release(struct lxhfs_inode *inode)
+{
+    if (inode->rsv_slot < 0)
+    {
+        return;
+    }
+    lxhfs_bitmap_unreserve(&lxhfs_super.bm_data, inode->rsv_start, inode->rsv_len);
+    lxhfs_super.rsv_owner[inode->rsv_slot] = NULL;
+    inode->rsv_slot = -1;
+    inode->rsv_start = inode->rsv_len = 0;
+}
+
+/**
+ * @brief 收回所有预留窗口，空间不够或卸载时调用
+ */
+static void lxhfs_rsv_drop_all()
+{
+    int slot;
+    for (slot = 0; slot < LXHFS_RSV_SLOTS; slot++)
+    {
+        if (lxhfs_super.rsv_owner[slot] != NULL)
+        {
+            lxhfs_rsv_release(lxhfs_super.rsv_owner[slot]);
+        }
+    }
+}
+
+/**
+ * @brief 文件在末尾长出新块后，在最后一块之后预留一个窗口，长度与文件已有块数相同，
+ *        下次写回续写时直接从窗口中取，分几次写回的文件仍然连续。槽用完时收回最早的窗口
+ *
+ * @param inode
+ * @param blks 文件的数据块数
+ */
+static void lxhfs_rsv_refill(struct lxhfs_inode *inode, int blks)
+{
+    int start = inode->dno[blks - 1] + 1;
+    int want = blks < LXHFS_RSV_MAX_BLKS ? blks : LXHFS_RSV_MAX_BLKS;
+    int slot;
+
+    if (inode->rsv_slot >= 0 && inode->rsv_start != start)
+    {
+        lxhfs_rsv_release(inode);
+    }
+    if (inode->rsv_slot < 0)
+    {
+        slot = lxhfs_super.rsv_next;
+        lxhfs_super.rsv_next = (slot + 1) % LXHFS_RSV_SLOTS;
+        if (lxhfs_super.rsv_owner[slot] != NULL)
+        {
+            lxhfs_rsv_release(lxhfs_super.rsv_owner[slot]);
+        }
+        lxhfs_super.rsv_owner[slot] = inode;
+        inode->rsv_slot = slot;
+        inode->rsv_start = start;
+        inode->rsv_len = 0;
+    }
+    if (inode->rsv_len < want)
+    {
+        inode->rsv_len += lxhfs_bitmap_reserve(&lxhfs_super.bm_data, start + inode->rsv_len, want - inode->rsv_len);
+    }
+    if (inode->rsv_len == 0)
+    {
+        lxhfs_rsv_release(inode);
+    }
+}
+
+/**
+ * @brief 分配一段连续的数据块，占用数据位图。空间不够时先收回所有预留窗口再试
+ *
+ * @param goal 优先从这里开始找够len块的空闲段
+ * @param len 想要的块数
+ * @param got 实际分到的块数
+ * @return int 起始数据块号，失败返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_alloc_run(int goal, int len, int *got)
+{
+    int dno = lxhfs_bitmap_alloc_run(&lxhfs_super.bm_data, goal, len, got);
+    if (dno < 0 && lxhfs_super.bm_data.nrsv > 0)
+    {
+        lxhfs_rsv_drop_all();
+        dno = lxhfs_bitmap_alloc_run(&lxhfs_super.bm_data, goal, len, got);
+    }
+    if (dno < 0)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    lxhfs_data_taken(dno, *got);
+    return dno;
+}
+
+/**
+ * @brief 分配一个数据块，占用数据位图
+ *
+ * @param goal 优先分配的块号，已占用时取其后最近的空闲块
+ * @return int 数据块号dno，失败返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_alloc_data(int goal)
+{
+    int got;
+    return lxhfs_alloc_run(goal, 1, &got);
+}
+
+/**
+ * @brief 为文件的[blk, blk + len)分配数据块。紧接前一块续写时依次从预留窗口、
+ *        前一块之后的空闲块中取；否则另起一段，普通文件找的空闲段还要留出预留窗口的长度，
+ *        以后续写时不会被紧挨着分配的别的文件挡住
+ *
+ * @param inode
+ * @param blk
+ * @param len
+ * @param got 实际分到的块数
+ * @return int 起始数据块号，失败返回-LXHFS_ERROR_NOSPACE
+ */
+static int lxhfs_alloc_file_run(struct lxhfs_inode *inode, int blk, int len, int *got)
+{
+    int goal = lxhfs_group_goal(inode, blk);
+    boolean is_next = blk > 0 && inode->dno[blk - 1] != LXHFS_DNO_NONE;
+    int win = blk + len < LXHFS_RSV_MAX_BLKS ? blk + len : LXHFS_RSV_MAX_BLKS;
+    int dno;
+
+    if (is_next && inode->rsv_slot >= 0 && inode->rsv_start == goal && inode->rsv_len > 0)
+    {
+        *got = len < inode->rsv_len ? len : inode->rsv_len;
+        lxhfs_bitmap_claim(&lxhfs_super.bm_data, goal, *got);
+        inode->rsv_start += *got;
+        inode->rsv_len -= *got;
+        lxhfs_data_taken(goal, *got);
+        return goal;
+    }
+    if (is_next && (*got = lxhfs_bitmap_extend(&lxhfs_super.bm_data, goal, len)) > 0)
+    {
+        lxhfs_data_taken(goal, *got);
+        return goal;
+    }
+    if (LXHFS_IS_REG(inode) && (dno = lxhfs_bitmap_find(&lxhfs_super.bm_data, goal, len + win)) >= 0)
+    {
+        *got = lxhfs_bitmap_extend(&lxhfs_super.bm_data, dno, len);
+        lxhfs_data_taken(dno, *got);
+        return dno;
+    }
+    return lxhfs_alloc_run(goal, len, got);
+}
+
+/**
+ * @brief 释放一个数据块，并记入待discard位图，在写回提交后统一下发
+ *
+ * @param dno
+ */
+void lxhfs_free_data(int dno)
+{
+    lxhfs_bitmap_clear(&lxhfs_super.bm_data, dno);
+    lxhfs_super.groups[LXHFS_DATA_GROUP(dno)].free_data++;
+    lxhfs_group_touch(LXHFS_DATA_GROUP(dno));
+    lxhfs_super.map_discard[dno / UINT8_BITS] |= (0x1 << (dno % UINT8_BITS));
+    lxhfs_super.has_discard = TRUE;
+    lxhfs_super.is_dirty = TRUE;
+    lxhfs_buf_drop(LXHFS_BUF_BLKNO(LXHFS_DATA_OFS(dno)));
+    lxhfs_journal_revoke(LXHFS_BUF_BLKNO(LXHFS_DATA_OFS(dno))); /* 可能是记过日志的目录块 */
+}
+
+/**
+ * @brief 调整inode占用的数据块：前blks个块按需分配，其余的块释放。
+ *        只在写回时调用，此时文件大小已经确定，缺的块连成一段一次分配。
+ *        内存中的数据块不动，转为内嵌时第0块的内容还要用
+ *
+ * @param inode
+ * @param blks 需要的数据块数
+ * @return int
+ */
+int lxhfs_resize_data(struct lxhfs_inode *inode, int blks)
+{
+    int blk, end, dno, got, i;
+    boolean is_grown = FALSE;
+    lxhfs_extent_grow(inode, blks);
+    for (blk = 0; blk < inode->blk_cap; blk++)
+    {
+        if (blk < blks && inode->dno[blk] == LXHFS_DNO_NONE)
+        {
+            end = blk + 1;
+            while (end < blks && inode->dno[end] == LXHFS_DNO_NONE)
+            {
+                end++;
+            }
+            dno = lxhfs_alloc_file_run(inode, blk, end - blk, &got);
+            if (dno < 0)
+            {
+                return dno;
+            }
+            for (i = 0; i < got; i++)
+            {
+                inode->dno[blk + i] = dno + i;
+                /* 新块上可能是别的文件留下的旧数据，必须写一次 */
+                lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY, blk + i);
+            }
+            blk += got - 1;
+            is_grown = TRUE;
+        }
+        else if (blk >= blks && inode->dno[blk] != LXHFS_DNO_NONE)
+        {
+            lxhfs_rsv_release(inode); /* 文件变短，窗口不再紧接最后一块 */
+            lxhfs_free_data(inode->dno[blk]);
+            inode->dno[blk] = LXHFS_DNO_NONE;
+            lxhfs_mark_data_clean(inode, blk);
+            lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY, -1);
+        }
+    }
+    if (is_grown && LXHFS_IS_REG(inode))
+    {
+        lxhfs_rsv_refill(inode, blks);
+    }
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 将待discard位图中连续的已释放块合并成区间，每个区间下发一次discard
+ *
+ * @return int
+ */
+int lxhfs_discard_flush()
+{
+    struct ddriver_range range;
+    int dno, start = -1;
+    boolean is_free;
+    if (!lxhfs_super.has_discard)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    for (dno = 0; dno <= lxhfs_super.max_data; dno++)
+    {
+        is_free = dno < lxhfs_super.max_data &&
+                  (lxhfs_super.map_discard[dno / UINT8_BITS] & (0x1 << (dno % UINT8_BITS)));
+        /*相邻块组的数据片之间隔着inode片，区间不能跨块组*/
+        if (start >= 0 && (!is_free || LXHFS_DATA_GROUP(dno) != LXHFS_DATA_GROUP(start)))
+        { /* [start, dno) 是一段连续的已释放块 */
+            range.offset = LXHFS_DATA_OFS(start);
+            range.size = LXHFS_BLKS_SZ((uint64_t)(dno - start));
+            if (ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_DEVICE_DISCARD, &range) < 0)
+            {
+                return -LXHFS_ERROR_IO;
+            }
+            start = -1;
+        }
+        if (is_free && start < 0)
+        {
+            start = dno;
+        }
+    }
+    memset(lxhfs_super.map_discard, 0, LXHFS_BLKS_SZ(lxhfs_super.map_data_blks));
+    lxhfs_super.has_discard = FALSE;
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把inode挂到常驻数据块LRU链表的表尾(最近使用)
+ *
+ * @param inode
+ */
+void lxhfs_data_touch(struct lxhfs_inode *inode)
+{
+    if (lxhfs_super.res_tail == inode)
+    {
+        return;
+    }
+    lxhfs_data_unlist(inode);
+    inode->res_prev = lxhfs_super.res_tail;
+    inode->res_next = NULL;
+    if (lxhfs_super.res_tail != NULL)
+    {
+        lxhfs_super.res_tail->res_next = inode;
+    }
+    else
+    {
+        lxhfs_super.res_head = inode;
+    }
+    lxhfs_super.res_tail = inode;
+}
+
+/**
+ * @brief 把inode从常驻数据块LRU链表摘下
+ *
+ * @param inode
+ */
+void lxhfs_data_unlist(struct lxhfs_inode *inode)
+{
+    if (inode->res_prev == NULL && lxhfs_super.res_head != inode)
+    {
+        return;
+    }
+    if (inode->res_prev != NULL)
+    {
+        inode->res_prev->res_next = inode->res_next;
+    }
+    else
+    {
+        lxhfs_super.res_head = inode->res_next;
+    }
+    if (inode->res_next != NULL)
+    {
+        inode->res_next->res_prev = inode->res_prev;
+    }
+    else
+    {
+        lxhfs_super.res_tail = inode->res_prev;
+    }
+    inode->res_prev = inode->res_next = NULL;
+}
+
+/**
+ * @brief 释放第blk个数据块在内存中的副本，不影响磁盘上的块
+ *
+ * @param inode
+ * @param blk
+ */
+void lxhfs_data_put(struct lxhfs_inode *inode, int blk)
+{
+    if (inode->data[blk] == NULL)
+    {
+        return;
+    }
+    free(inode->data[blk]);
+    inode->data[blk] = NULL;
+    inode->res_cnt--;
+    lxhfs_super.data_resident--;
+    if (inode->res_cnt == 0)
+    {
+        lxhfs_data_unlist(inode);
+    }
+}
+
+/**
+ * @brief 读入[from, to)中已分配但不在内存的数据块，一次提交全部读请求。
+ *        物理上连续的块合成一个请求，顺序读一个区段只下发一次。
+ *        未分配的块读出来是0，不分配内存
+ *
+ * @param inode
+ * @param from
+ * @param to
+ * @return int
+ */
+int lxhfs_data_load(struct lxhfs_inode *inode, int from, int to)
+{
+    struct ddriver_io *ios;
+    int *first;
+    int nr = 0, blk, i, ret = LXHFS_ERROR_NONE;
+    to = to < inode->blk_cap ? to : inode->blk_cap;
+    if (from >= to)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    ios = (struct ddriver_io *)malloc((to - from) * sizeof(struct ddriver_io));
+    first = (int *)malloc((to - from) * sizeof(int));
+    for (blk = from; blk < to; blk++)
+    {
+        if (inode->data[blk] != NULL || inode->dno[blk] == LXHFS_DNO_NONE)
+        {
+            continue;
+        }
+        inode->data[blk] = (uint8_t *)malloc(LXHFS_BLK_SZ());
+        inode->res_cnt++;
+        lxhfs_super.data_resident++;
+        lxhfs_super.data_faults++;
+        /*接在上一个请求之后的块并入该请求*/
+        if (nr > 0 && blk == first[nr - 1] + (int)(ios[nr - 1].size / LXHFS_BLK_SZ()) &&
+            ios[nr - 1].offset + ios[nr - 1].size == LXHFS_DATA_OFS(inode->dno[blk]))
+        {
+            ios[nr - 1].size += LXHFS_BLK_SZ();
+            continue;
+        }
+        first[nr] = blk;
+        ios[nr].opcode = DDRIVER_OP_READ;
+        ios[nr].flags = 0;
+        ios[nr].size = LXHFS_BLK_SZ();
+        ios[nr].offset = LXHFS_DATA_OFS(inode->dno[blk]);
+        nr++;
+    }
+    for (i = 0; i < nr; i++)
+    { /* 单块请求直接读进数据块，多块请求先读进临时缓冲再分发 */
+        ios[i].buf = ios[i].size == (size_t)LXHFS_BLK_SZ() ? (char *)inode->data[first[i]] : (char *)malloc(ios[i].size);
+    }
+    if (inode->res_cnt > 0)
+    {
+        lxhfs_data_touch(inode);
+    }
+    if (nr > 0 && lxhfs_driver_batch(ios, nr) != LXHFS_ERROR_NONE)
+    {
+        LXHFS_DBG("[%s] io error\n", __func__);
+        ret = -LXHFS_ERROR_IO;
+    }
+    for (i = 0; i < nr; i++)
+    {
+        if (ios[i].size == (size_t)LXHFS_BLK_SZ())
+        {
+            continue;
+        }
+        for (blk = 0; blk < (int)(ios[i].size / LXHFS_BLK_SZ()); blk++)
+        {
+            memcpy(inode->data[first[i] + blk], ios[i].buf + LXHFS_BLKS_SZ(blk), LXHFS_BLK_SZ());
+        }
+        free(ios[i].buf);
+    }
+    free(first);
+    free(ios);
+    return ret;
+}
+
+/**
+ * @brief 常驻的数据块超过上限时，从最久未用的inode开始释放干净的数据块。
+ *        脏块要等写回之后才能释放
+ */
+void lxhfs_data_evict()
+{
+    struct lxhfs_inode *inode = lxhfs_super.res_head, *next;
+    int blk;
+    while (inode != NULL && lxhfs_super.data_limit > 0 && lxhfs_super.data_resident > lxhfs_super.data_limit)
+    {
+        next = inode->res_next;
+        for (blk = 0; blk < inode->blk_cap && lxhfs_super.data_resident > lxhfs_super.data_limit; blk++)
+        {
+            if (inode->data[blk] != NULL && inode->dno[blk] != LXHFS_DNO_NONE && !LXHFS_DATA_IS_DIRTY(inode, blk))
+            {
+                lxhfs_data_put(inode, blk);
+                lxhfs_super.data_evicts++;
+            }
+        }
+        inode = next;
+    }
+}
+
+/**
+ * @brief 大小为size的文件写回时占用的数据块数，放得下内嵌的不占数据块
+ *
+ * @param size
+ * @return int
+ */
+static int lxhfs_data_need(int size)
+{
+    return size <= LXHFS_INLINE_SZ() ? 0 : LXHFS_ROUND_UP(size, LXHFS_BLK_SZ()) / LXHFS_BLK_SZ();
+}
+
+/**
+ * @brief 数一数[from, to)中尚未分配的数据块
+ *
+ * @param inode
+ * @param from
+ * @param to
+ * @return int
+ */
+static int lxhfs_data_holes(struct lxhfs_inode *inode, int from, int to)
+{
+    int blk, holes = 0;
+    for (blk = from; blk < to; blk++)
+    {
+        if (blk >= inode->blk_cap || inode->dno[blk] == LXHFS_DNO_NONE)
+        {
+            holes++;
+        }
+    }
+    return holes;
+}
+
+/**
+ * @brief 设置inode尚未分配的数据块数，同时修改总数
+ *
+ * @param inode
+ * @param blks
+ */
+static void lxhfs_pend_set(struct lxhfs_inode *inode, int blks)
+{
+    blks = blks > 0 ? blks : 0;
+    lxhfs_super.pend_blks += blks - inode->pend_blks;
+    inode->pend_blks = blks;
+}
+
+/**
+ * @brief 文件变长到size前预订新增的数据块。数据块在写回时才分配，写入时就按
+ *        空闲块数扣除已预订的块判断空间，不能等到写回时才发现不够
+ *
+ * @param inode 普通文件
+ * @param size 新的大小
+ * @return int 空间不够返回-LXHFS_ERROR_NOSPACE
+ */
+int lxhfs_data_charge(struct lxhfs_inode *inode, int size)
+{
+    int more = lxhfs_data_need(size) - lxhfs_data_need(inode->size);
+    if (more <= 0)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    /*预留窗口中的块在空间不够时会被收回，也算作空闲*/
+    if (lxhfs_super.pend_blks + more > lxhfs_super.bm_data.nfree + lxhfs_super.bm_data.nrsv)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    lxhfs_pend_set(inode, inode->pend_blks + more);
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在文件的数据块与buf之间拷贝，跨块时逐块处理。不在内存的块先读入，
+ *        从未写过的块读出0且不占内存
+ *
+ * @param inode 普通文件
+ * @param offset 文件内偏移
+ * @param buf 为NULL且is_write时写入0
+ * @param size
+ * @param is_write TRUE: buf写入文件；FALSE: 文件读到buf
+ * @return int
+ */
+int lxhfs_data_copy(struct lxhfs_inode *inode, uint64_t offset, uint8_t *buf, int size, boolean is_write)
+{
+    int blk, bias, len, done = 0;
+    if (size <= 0)
+    {
+        return LXHFS_ERROR_NONE;
+    }
+    lxhfs_extent_grow(inode, (offset + size - 1) / LXHFS_BLK_SZ() + 1);
+    /*涉及的块一次读入；整块覆盖的块不必读*/
+    if (!is_write)
+    {
+        blk = (offset + size - 1) / LXHFS_BLK_SZ() + 1;
+        if (lxhfs_data_load(inode, offset / LXHFS_BLK_SZ(), blk) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    else
+    {
+        if (offset % LXHFS_BLK_SZ() != 0 &&
+            lxhfs_data_load(inode, offset / LXHFS_BLK_SZ(), offset / LXHFS_BLK_SZ() + 1) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        if ((offset + size) % LXHFS_BLK_SZ() != 0 &&
+            lxhfs_data_load(inode, (offset + size) / LXHFS_BLK_SZ(), (offset + size) / LXHFS_BLK_SZ() + 1) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    while (done < size)
+    {
+        blk = (offset + done) / LXHFS_BLK_SZ();
+        bias = (offset + done) % LXHFS_BLK_SZ();
+        len = LXHFS_BLK_SZ() - bias < size - done ? LXHFS_BLK_SZ() - bias : size - done;
+        if (!is_write)
+        {
+            if (inode->data[blk] != NULL)
+            {
+                memcpy(buf + done, inode->data[blk] + bias, len);
+            }
+            else
+            {
+                memset(buf + done, 0, len);
+            }
+            done += len;
+            continue;
+        }
+        if (inode->data[blk] == NULL)
+        {
+            if (buf == NULL && inode->dno[blk] == LXHFS_DNO_NONE)
+            { /* 从未写过的块本来就是0 */
+                done += len;
+                continue;
+            }
+            inode->data[blk] = (uint8_t *)calloc(1, LXHFS_BLK_SZ());
+            inode->res_cnt++;
+            lxhfs_super.data_resident++;
+            lxhfs_data_touch(inode);
+        }
+        if (buf == NULL)
+        {
+            memset(inode->data[blk] + bias, 0, len);
+        }
+        else
+        {
+            memcpy(inode->data[blk] + bias, buf + done, len);
+        }
+        lxhfs_mark_dirty(inode, 0, blk);
+        done += len;
+    }
+    lxhfs_data_evict();
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 截短文件：size所在块的剩余部分清零，之后的整块直接释放，再变长时读出0
+ *
+ * @param inode 普通文件
+ * @param size 新的大小，小于当前大小
+ * @return int
+ */
+int lxhfs_data_truncate(struct lxhfs_inode *inode, int size)
+{
+    int keep = LXHFS_ROUND_UP(size, LXHFS_BLK_SZ()) / LXHFS_BLK_SZ();
+    int tail = LXHFS_BLKS_SZ(keep) < inode->size ? LXHFS_BLKS_SZ(keep) : inode->size;
+    int blk;
+    if (lxhfs_data_copy(inode, size, NULL, tail - size, TRUE) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    /*截掉的部分中尚未分配的块不再需要*/
+    lxhfs_pend_set(inode, inode->pend_blks - lxhfs_data_holes(inode, lxhfs_data_need(size), lxhfs_data_need(inode->size)));
+    for (blk = keep; blk < inode->blk_cap; blk++)
+    {
+        lxhfs_data_put(inode, blk);
+        lxhfs_mark_data_clean(inode, blk);
+        if (inode->dno[blk] != LXHFS_DNO_NONE)
+        {
+            lxhfs_free_data(inode->dno[blk]);
+            inode->dno[blk] = LXHFS_DNO_NONE;
+        }
+    }
+    lxhfs_rsv_release(inode); /* 窗口不再紧接最后一块 */
+    lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY, -1);
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放inode及其数据块，dentry不再指向它
+ *
+ * @param inode
+ * @return int
+ */
+int lxhfs_drop_inode(struct lxhfs_inode *inode)
+{
+    int ino = inode->ino;
+    int blk;
+    lxhfs_bitmap_clear(&lxhfs_super.bm_inode, ino);
+    lxhfs_super.groups[LXHFS_INO_GROUP(ino)].free_inodes++;
+    if (LXHFS_IS_DIR(inode))
+    {
+        lxhfs_super.groups[LXHFS_INO_GROUP(ino)].dirs--;
+    }
+    lxhfs_group_touch(LXHFS_INO_GROUP(ino));
+    lxhfs_super.is_dirty = TRUE;
+    lxhfs_resize_data(inode, 0);
+    lxhfs_rsv_release(inode); /* 没有块可释放时resize_data不会收回窗口 */
+    lxhfs_pend_set(inode, 0);
+    lxhfs_extent_free(inode);
+    for (blk = 0; blk < inode->blk_cap; blk++)
+    {
+        lxhfs_data_put(inode, blk);
+    }
+    lxhfs_mark_clean(inode); /* 已释放，不再写回 */
+    lxhfs_extent_destroy(inode);
+    lxhfs_dir_destroy(inode);
+    inode->dentry->inode = NULL;
+    free(inode);
+    return LXHFS_ERROR_NONE;
+}
+
+/**
+ * @brief 从目录inode中摘除一个dentry。dentry由调用者在释放它指向的inode后释放
+ *
+ * @param inode
+ * @param dentry
+ * @return int 目录中剩下的目录项数，失败时目录不变
+ */
+int lxhfs_drop_dentry(struct lxhfs_inode *inode, struct lxhfs_dentry *dentry)
+{
+    if (lxhfs_dir_load(inode) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    if (lxhfs_dir_remove(inode, dentry) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_NOTFOUND;
+    }
+    inode->dir_cnt--;
+    lxhfs_mark_dirty(inode, LXHFS_FLAG_INODE_DIRTY | LXHFS_FLAG_DIR_DIRTY, -1);
+    return inode->dir_cnt;
+}
+
+/**
+ * @brief 将内存inode及其下方结构全部刷回磁盘
+ *
+ * @param inode
+ * @return int
+ */
+int lxhfs_sync_inode(struct lxhfs_inode *inode)
+{
+    struct lxhfs_inode_d *inode_d;
+    struct lxhfs_dentry *dentry_cursor;
+    struct lxhfs_dentry_d *dentry_d;
+    uint8_t *blk_buf, *dx_buf = NULL;
+    int ino = inode->ino;
+    int dno_cnt, blks, dir_cursor, ino_sz;
+    boolean is_inline;
+    uint64_t offset;
+
+    /* Cycle 0: 先按当前大小分配/释放数据块，保证写出的inode指向有效的块；放得下的内嵌在inode块中 */
+    if (LXHFS_IS_DIR(inode))
+    {
+        is_inline = inode->dir_cnt <= LXHFS_INLINE_DENTRYS();
+        /*目录项有增删时重建索引，建不成的按线性格式写；没有修改的沿用原来的格式*/
+        if (inode->flags & LXHFS_FLAG_DIR_DIRTY)
+        {
+            dx_buf = is_inline ? NULL : lxhfs_dx_build(inode, LXHFS_BLK_SZ(), &inode->dx_blks);
+            if (dx_buf == NULL)
+            {
+                inode->dx_blks = 0;
+            }
+        }
+        blks = inode->dx_blks > 0 ? inode->dx_blks
+                                  : LXHFS_ROUND_UP(inode->dir_cnt, LXHFS_DENTRY_PER_BLK()) / LXHFS_DENTRY_PER_BLK();
+    }
+    else
+    {
+        blks = LXHFS_ROUND_UP(inode->size, LXHFS_BLK_SZ()) / LXHFS_BLK_SZ();
+        is_inline = inode->size <= LXHFS_INLINE_SZ();
+        /*从数据块转为内嵌：第0块先读进内存，块释放后内容随inode写出*/
+        if (is_inline && inode->blk_cap > 0 && inode->dno[0] != LXHFS_DNO_NONE &&
+            lxhfs_data_load(inode, 0, 1) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+    }
+    if (lxhfs_resize_data(inode, is_inline ? 0 : blks) != LXHFS_ERROR_NONE)
+    {
+        LXHFS_DBG("[%s] no space\n", __func__);
+        lxhfs_pend_set(inode, lxhfs_data_holes(inode, 0, is_inline ? 0 : blks)); /* 已分到的块不再计入 */
+        free(dx_buf);
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    lxhfs_pend_set(inode, 0);
+    /*内嵌的内容有修改即重写inode块*/
+    if (is_inline && (inode->data_dirty_cnt > 0 || (inode->flags & LXHFS_FLAG_DIR_DIRTY)))
+    {
+        inode->flags |= LXHFS_FLAG_INODE_DIRTY;
+    }
+
+    /* Cycle 1: 写 INODE，只写有修改的；数据块映射合并成区段，内嵌的内容紧跟其后一并写出 */
+    if (inode->flags & LXHFS_FLAG_INODE_DIRTY)
+    {
+        ino_sz = sizeof(struct lxhfs_inode_d);
+        if (is_inline)
+        {
+            ino_sz += LXHFS_IS_DIR(inode) ? inode->dir_cnt * (int)sizeof(struct lxhfs_dentry_d) : inode->size;
+        }
+        blk_buf = (uint8_t *)calloc(1, ino_sz);
+        inode_d = (struct lxhfs_inode_d *)blk_buf;
+        inode_d->ino = ino;
+        inode_d->size = inode->size;
+        inode_d->ftype = inode->dentry->ftype;
+        inode_d->dir_cnt = inode->dir_cnt;
+        inode_d->flags = is_inline ? LXHFS_INODE_INLINE : (inode->dx_blks > 0 ? LXHFS_INODE_INDEXED : 0);
+        if (lxhfs_extent_pack(inode, inode_d) != LXHFS_ERROR_NONE)
+        {
+            LXHFS_DBG("[%s] no space\n", __func__);
+            free(blk_buf);
+            free(dx_buf);
+            return -LXHFS_ERROR_NOSPACE;
+        }
+        if (is_inline && LXHFS_IS_DIR(inode))
+        {
+            dentry_d = (struct lxhfs_dentry_d *)(inode_d + 1);
+            for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother)
+            {
+                lxhfs_dentry_to_disk(dentry_d++, dentry_cursor);
+            }
+        }
+        else if (is_inline && inode->size > 0 && inode->blk_cap > 0 && inode->data[0] != NULL)
+        {
+            memcpy(inode_d + 1, inode->data[0], inode->size);
+        }
+        if (lxhfs_journal_write(LXHFS_INO_OFS(ino), blk_buf, ino_sz) != LXHFS_ERROR_NONE)
+        {
+            LXHFS_DBG("[%s] io error\n", __func__);
+            free(blk_buf);
+            free(dx_buf);
+            return -LXHFS_ERROR_IO;
+        }
+        free(blk_buf);
+    }
+    inode->flags &= ~LXHFS_FLAG_INODE_DIRTY;
+    if (is_inline)
+    {
+        inode->flags &= ~LXHFS_FLAG_DIR_DIRTY;
+    }
+
+    /* Cycle 2: 写 数据 */
+    if (dx_buf != NULL)
     {
-        ddriver_read(LXHFS_DRIVER(), cur, LXHFS_IO_SZ()); // ddriver_read第三个参数size要等于设备IO单位的大小
-        cur += LXHFS_IO_SZ();
-        size_aligned -= LXHFS_IO_SZ();
+        /*带索引的目录连同索引块整体重写*/
+        for (dno_cnt = 0; dno_cnt < inode->dx_blks; dno_cnt++)
+        {
+            if (lxhfs_journal_write(LXHFS_DATA_OFS(inode->dno[dno_cnt]), dx_buf + dno_cnt * LXHFS_BLK_SZ(),
+                                    LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+            {
+                LXHFS_DBG("[%s] io error\n", __func__);
+                free(dx_buf);
+                return -LXHFS_ERROR_IO;
+            }
+        }
+        free(dx_buf);
+        inode->flags &= ~LXHFS_FLAG_DIR_DIRTY;
     }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
+    else if (LXHFS_IS_DIR(inode) && (inode->flags & LXHFS_FLAG_DIR_DIRTY))
+    {
+        /*目录项先在内存中拼成整块，每个目录块只写一次，不再逐项读改写*/
+        blk_buf = (uint8_t *)malloc(LXHFS_BLK_SZ());
+        dir_cursor = 0;
+        dentry_cursor = inode->dentrys;
+        while (dentry_cursor != NULL)
+        {
+            /*第dir_cursor个目录项位于第dir_cursor / DENTRY_PER_BLK个数据块*/
+            if (dir_cursor % LXHFS_DENTRY_PER_BLK() == 0)
+            {
+                memset(blk_buf, 0, LXHFS_BLK_SZ());
+            }
+            dentry_d = (struct lxhfs_dentry_d *)blk_buf + dir_cursor % LXHFS_DENTRY_PER_BLK();
+            lxhfs_dentry_to_disk(dentry_d, dentry_cursor);
+            dentry_cursor = dentry_cursor->brother;
+            dir_cursor++;
+            /*块已填满或目录项已写完时写出整块*/
+            if (dir_cursor % LXHFS_DENTRY_PER_BLK() == 0 || dentry_cursor == NULL)
+            {
+                offset = LXHFS_DATA_OFS(inode->dno[(dir_cursor - 1) / LXHFS_DENTRY_PER_BLK()]);
+                if (lxhfs_journal_write(offset, blk_buf, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+                {
+                    LXHFS_DBG("[%s] io error\n", __func__);
+                    free(blk_buf);
+                    return -LXHFS_ERROR_IO;
+                }
+            }
+        }
+        free(blk_buf);
+        inode->flags &= ~LXHFS_FLAG_DIR_DIRTY;
+    }
+    if (LXHFS_IS_REG(inode))
+    {
+        /*inode对应文件格式的写入，只写已分配且有修改的数据块；新分配却没写过的块写0*/
+        blk_buf = NULL;
+        for (dno_cnt = 0; dno_cnt < inode->blk_cap && inode->data_dirty_cnt > 0; dno_cnt++)
+        {
+            if (inode->dno[dno_cnt] == LXHFS_DNO_NONE || !LXHFS_DATA_IS_DIRTY(inode, dno_cnt))
+            {
+                continue;
+            }
+            if (inode->data[dno_cnt] == NULL && blk_buf == NULL)
+            {
+                blk_buf = (uint8_t *)calloc(1, LXHFS_BLK_SZ());
+            }
+            if (lxhfs_driver_write(LXHFS_DATA_OFS(inode->dno[dno_cnt]),
+                                   inode->data[dno_cnt] != NULL ? inode->data[dno_cnt] : blk_buf,
+                                   LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+            {
+                LXHFS_DBG("[%s] io error\n", __func__);
+                free(blk_buf);
+                return -LXHFS_ERROR_IO;
+            }
+        }
+        free(blk_buf);
+    }
+    lxhfs_mark_clean(inode);
+    /*写回后的块变干净，可以淘汰*/
+    lxhfs_data_evict();
     return LXHFS_ERROR_NONE;
 }
+
 /**
- * @brief 驱动写
+ * @brief 从最早变脏的inode开始写回，写够max_blks个块即停，剩下的留到下一轮。
+ *        写不回的inode留在脏链表中，跳过它继续写回其余的inode
  *
- * @param offset
- * @param in_content
- * @param size
- * @return int
+ * @param max_blks 本轮最多写回的块数，小于0时全部写回
+ * @return int 有inode写不回时返回第一个错误
  */
-int lxhfs_driver_write(int offset, uint8_t *in_content, int size)
+int lxhfs_sync_dirty(int max_blks)
 {
-    int offset_aligned = LXHFS_ROUND_DOWN(offset, LXHFS_BLK_SZ());
-    int bias = offset - offset_aligned;
-    int size_aligned = LXHFS_ROUND_UP((size + bias), LXHFS_BLK_SZ());
-    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
-    lxhfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-
-    // lseek(LXHFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(LXHFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    struct lxhfs_inode *inode, *next;
+    int done = 0, ret = LXHFS_ERROR_NONE, err;
+    for (inode = lxhfs_super.dirty_head; inode != NULL && (max_blks < 0 || done < max_blks); inode = next)
     {
-        // write(LXHFS_DRIVER(), cur, LXHFS_IO_SZ());
-        ddriver_write(LXHFS_DRIVER(), cur, LXHFS_IO_SZ()); // ddriver_write第三个参数size要等于设备IO单位的大小
-        cur += LXHFS_IO_SZ();
-        size_aligned -= LXHFS_IO_SZ();
+        next = inode->dirty_next;
+        done += LXHFS_ROUND_UP(inode->dirty_bytes, LXHFS_BLK_SZ()) / LXHFS_BLK_SZ();
+        err = lxhfs_sync_inode(inode);
+        if (err != LXHFS_ERROR_NONE && ret == LXHFS_ERROR_NONE)
+        {
+            ret = err;
+        }
     }
-
-    free(temp_content);
-    return LXHFS_ERROR_NONE;
+    return ret;
 }
 
 /**
- * @brief 为一个inode分配dentry，采用头插法
+ * @brief 把位图中有修改的块记入日志
  *
- * @param inode
- * @param dentry
+ * @param bm
+ * @param offset 位图在磁盘上的偏移
  * @return int
  */
-int lxhfs_alloc_dentry(struct lxhfs_inode *inode, struct lxhfs_dentry *dentry)
+static int lxhfs_sync_map(struct lxhfs_bitmap *bm, uint64_t offset)
 {
-    if (inode->dentrys == NULL)
-    {
-        inode->dentrys = dentry;
-    }
-    else
+    int blk, blks = (bm->nwords + bm->blk_words - 1) / bm->blk_words;
+    for (blk = 0; blk < blks; blk++)
     {
-        dentry->brother = inode->dentrys;
-        inode->dentrys = dentry;
+        if (!bm->dirty[blk])
+        {
+            continue;
+        }
+        if (lxhfs_journal_write(offset + LXHFS_BLKS_SZ(blk), (uint8_t *)(bm->words + blk * bm->blk_words),
+                                LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        bm->dirty[blk] = 0;
     }
-    inode->dir_cnt++;
-    return inode->dir_cnt;
+    return LXHFS_ERROR_NONE;
 }
 
 /**
- * @brief 分配一个inode，占用位图
+ * @brief 有分配或释放时，写回超级块和两张位图
  *
- * @param dentry 该dentry指向分配的inode
- * @return lxhfs_inode
+ * @return int
  */
-struct lxhfs_inode *lxhfs_alloc_inode(struct lxhfs_dentry *dentry)
+int lxhfs_sync_super()
 {
-    struct lxhfs_inode *inode;
-    int byte_cursor = 0;
-    int bit_cursor = 0;
-    int ino_cursor = 0;
-    int dno_cursor = 0;
-    int data_cnt = 0;
-    boolean is_find_free_entry = FALSE;
-    boolean is_find_free_enough = FALSE;
-    /*在inode位图上寻找未使用的inode节点*/
-    for (byte_cursor = 0; byte_cursor < LXHFS_BLKS_SZ(lxhfs_super.map_inode_blks);
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            if ((lxhfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0)
-            {
-                /* 当前ino_cursor位置空闲 */
-                lxhfs_super.map_inode[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;
-                break;
-            }
-            ino_cursor++;
-        }
-        if (is_find_free_entry)
-        {
-            break;
-        }
-    }
+    struct lxhfs_super_d lxhfs_super_d;
 
-    /*为目录项分配inode节点*/
-    if (!is_find_free_entry || ino_cursor == lxhfs_super.max_ino)
-        return -LXHFS_ERROR_NOSPACE;
-    inode = (struct lxhfs_inode *)malloc(sizeof(struct lxhfs_inode));
-    inode->ino = ino_cursor;
-    inode->size = 0;
+    if (!lxhfs_super.is_dirty)
+    {
+        return LXHFS_ERROR_NONE;
+    }
 
-    /*为目录项分配inode节点并建立他们之间的连接*/
-    /* dentry指向inode */
-    dentry->inode = inode;
-    dentry->ino = inode->ino;
-    /* inode指回dentry */
-    inode->dentry = dentry;
-    inode->dir_cnt = 0;
-    inode->dentrys = NULL;
+    /*将内存超级块转换为磁盘超级块并写入磁盘*/
+    lxhfs_super_d.magic_num = LXHFS_MAGIC_NUM;
+    lxhfs_super_d.max_ino = lxhfs_super.max_ino;
+    lxhfs_super_d.max_data = lxhfs_super.max_data;
+    lxhfs_super_d.map_inode_blks = lxhfs_super.map_inode_blks;
+    lxhfs_super_d.map_data_blks = lxhfs_super.map_data_blks;
+    lxhfs_super_d.map_inode_offset = lxhfs_super.map_inode_offset;
+    lxhfs_super_d.map_data_offset = lxhfs_super.map_data_offset;
+    lxhfs_super_d.inode_offset = lxhfs_super.inode_offset;
+    lxhfs_super_d.data_offset = lxhfs_super.data_offset;
+    lxhfs_super_d.sz_usage = lxhfs_super.sz_usage;
+    lxhfs_super_d.journal_offset = lxhfs_super.journal_offset;
+    lxhfs_super_d.journal_blks = lxhfs_super.journal_blks;
+    lxhfs_super_d.sz_inode = lxhfs_super.sz_inode;
+    lxhfs_super_d.inode_blks = lxhfs_super.inode_blks;
+    lxhfs_super_d.sz_blk = lxhfs_super.sz_blk;
+    lxhfs_super_d.group_desc_offset = lxhfs_super.group_desc_offset;
+    lxhfs_super_d.group_desc_blks = lxhfs_super.group_desc_blks;
+    lxhfs_super_d.group_cnt = lxhfs_super.group_cnt;
+    lxhfs_super_d.group_inodes = lxhfs_super.group_inodes;
+    lxhfs_super_d.group_data = lxhfs_super.group_data;
 
-    /*对于FILE类型直接读取数据*/
-    if (LXHFS_IS_REG(inode))
+    if (lxhfs_journal_write(LXHFS_SUPER_OFS, (uint8_t *)&lxhfs_super_d,
+                            sizeof(struct lxhfs_super_d)) != LXHFS_ERROR_NONE)
     {
-        for (int cnt = 0; cnt < LXHFS_DATA_PER_FILE; cnt++)
-        {
-            inode->data[cnt] = (uint8_t *)malloc(LXHFS_BLK_SZ());
-        }
+        return -LXHFS_ERROR_IO;
     }
 
-    return inode;
+    /*将inode位图和data位图写入磁盘，只写有修改的块，事务大小不随设备变大*/
+    if (lxhfs_sync_map(&lxhfs_super.bm_inode, lxhfs_super_d.map_inode_offset) != LXHFS_ERROR_NONE ||
+        lxhfs_sync_map(&lxhfs_super.bm_data, lxhfs_super_d.map_data_offset) != LXHFS_ERROR_NONE ||
+        lxhfs_group_sync() != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
+    }
+    lxhfs_super.is_dirty = FALSE;
+    return LXHFS_ERROR_NONE;
 }
 
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 一轮写回：最旧的脏inode、超级块和位图、块缓存中的脏块，
+ *        按偏移排队后一趟下发，最后提交元数据事务并要求设备落盘，再discard已释放的块
  *
- * @param inode
+ * @param max_blks 本轮最多写回的块数，小于0时全部写回
  * @return int
  */
-int lxhfs_sync_inode(struct lxhfs_inode *inode)
+int lxhfs_writeback(int max_blks)
 {
-    struct lxhfs_inode_d inode_d;
-    struct lxhfs_dentry *dentry_cursor;
-    struct lxhfs_dentry_d dentry_d;
-    int ino = inode->ino;
-    inode_d.ino = ino;
-    inode_d.size = inode->size;
-    inode_d.ftype = inode->dentry->ftype;
-    inode_d.dir_cnt = inode->dir_cnt;
-    int dno_cnt;
-    for (dno_cnt = 0; dno_cnt < LXHFS_DATA_PER_FILE; dno_cnt++)
+    int ret = LXHFS_ERROR_NONE, err;
+    lxhfs_plug();
+    /*记日志时元数据只进事务；本轮涉及的数据块全部写下，保证先于提交块落盘。
+      个别inode写不回(如分配不到块)时，其余inode的修改照常提交*/
+    err = lxhfs_sync_dirty(max_blks);
+    if (lxhfs_sync_super() != LXHFS_ERROR_NONE ||
+        lxhfs_buf_flush(lxhfs_super.journal_blks > 0 ? -1 : max_blks) != LXHFS_ERROR_NONE)
     {
-        inode_d.dno[dno_cnt] = inode->dno[dno_cnt];
+        ret = -LXHFS_ERROR_IO;
     }
-    int offset;
-
-    if (lxhfs_driver_write(LXHFS_INO_OFS(ino), (uint8_t *)&inode_d,
-                           sizeof(struct lxhfs_inode_d)) != LXHFS_ERROR_NONE)
+    if (lxhfs_unplug() != LXHFS_ERROR_NONE)
     {
-        LXHFS_DBG("[%s] io error\n", __func__);
-        return -LXHFS_ERROR_IO;
+        ret = -LXHFS_ERROR_IO;
+    }
+    if (ret == LXHFS_ERROR_NONE && lxhfs_journal_commit() != LXHFS_ERROR_NONE)
+    {
+        ret = -LXHFS_ERROR_IO;
+    }
+    /*释放提交后才能discard，否则崩溃后这些块仍属于原来的文件，内容却已丢失*/
+    if (ret == LXHFS_ERROR_NONE && lxhfs_discard_flush() != LXHFS_ERROR_NONE)
+    {
+        ret = -LXHFS_ERROR_IO;
     }
+    return ret != LXHFS_ERROR_NONE ? ret : err;
+}
 
-    /* Cycle 1: 写 INODE */
-    /* Cycle 2: 写 数据 */
-    if (LXHFS_IS_DIR(inode))
+/**
+ * @brief 后台刷写线程。脏数据停留超过wb_age、脏字节数或脏inode数超过阈值时，
+ *        取锁写回一轮，每轮至多wb_io个块，前台请求最多等待一轮
+ *
+ * @param arg
+ * @return void*
+ */
+void *lxhfs_writeback_thread(void *arg)
+{
+    struct timespec deadline;
+    long now, tick = lxhfs_super.wb_age / 4 > 10 ? lxhfs_super.wb_age / 4 : 10;
+    boolean expired, over, failed = FALSE;
+    int err;
+    pthread_mutex_lock(&lxhfs_super.lock);
+    while (lxhfs_super.wb_running)
     {
-        dno_cnt = 0;
-        dentry_cursor = inode->dentrys;
-        while (dentry_cursor != NULL && dno_cnt < LXHFS_DATA_PER_FILE)
+        now = lxhfs_now_ms();
+        expired = lxhfs_super.dirty_head != NULL &&
+                  now - lxhfs_super.dirty_head->dirtied_at >= lxhfs_super.wb_age;
+        over = lxhfs_super.dirty_bytes + LXHFS_BLKS_SZ((uint64_t)lxhfs_super.buf_dirty) >= (uint64_t)lxhfs_super.wb_bytes ||
+               lxhfs_super.dirty_inodes >= lxhfs_super.wb_inodes;
+        /*块缓存里的脏块都来自已触发的写回，上一轮没写完的继续写*/
+        if (expired || over || lxhfs_super.buf_dirty > 0)
         {
-            offset = LXHFS_DATA_OFS(inode->dno[dno_cnt]);
-            /*逐层进行目录的写入*/
-            while (dentry_cursor != NULL)
+            err = lxhfs_writeback(lxhfs_super.wb_io);
+            lxhfs_super.wb_rounds++;
+            if (err == LXHFS_ERROR_NONE)
             {
-                memcpy(dentry_d.fname, dentry_cursor->fname, LXHFS_MAX_FILE_NAME);
-                dentry_d.ftype = dentry_cursor->ftype;
-                dentry_d.ino = dentry_cursor->ino;
-                if (lxhfs_driver_write(offset, (uint8_t *)&dentry_d,
-                                       sizeof(struct lxhfs_dentry_d)) != LXHFS_ERROR_NONE)
-                {
-                    LXHFS_DBG("[%s] io error\n", __func__);
-                    return -LXHFS_ERROR_IO;
-                }
-                if (dentry_cursor->inode != NULL)
-                {
-                    lxhfs_sync_inode(dentry_cursor->inode);
-                }
-                dentry_cursor = dentry_cursor->brother;
-                offset += sizeof(struct lxhfs_dentry_d);
-                int dno_cursor = 0;
-                boolean is_find_free_enough = FALSE;
-                for (int byte_cursor = 0; byte_cursor < LXHFS_BLKS_SZ(lxhfs_super.map_data_blks);
-                     byte_cursor++)
-                {
-                    for (int bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-                    {
-                        if ((lxhfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0)
-                        {
-                            /* 当前dno_cursor位置空闲 */
-                            lxhfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-                            inode->dno[dno_cnt] = dno_cursor; /*为当前目录项分配data节点*/
-                            is_find_free_enough = TRUE;
-                            break;
-                        }
-                        dno_cursor++;
-                    }
-                    if (is_find_free_enough)
-                    {
-                        break;
-                    }
-                }
-                if (!is_find_free_enough || dno_cursor == lxhfs_super.max_data)
-                    return -LXHFS_ERROR_NOSPACE;
-                if ((offset + sizeof(struct lxhfs_dentry_d)) > LXHFS_DATA_OFS(inode->dno[dno_cnt] + 1))
-                { /*如果目录项在下一个数据块，则要更新offset*/
-                    break;
-                }
+                failed = FALSE;
+                /*让出锁，前台请求在两轮之间得以执行*/
+                pthread_mutex_unlock(&lxhfs_super.lock);
+                sched_yield();
+                pthread_mutex_lock(&lxhfs_super.lock);
+                continue;
             }
-            dno_cnt++;
-        }
-    }
-    else if (LXHFS_IS_REG(inode))
-    {
-        /*inode对应文件格式的写入*/
-        for (dno_cnt = 0; dno_cnt < LXHFS_DATA_PER_FILE; dno_cnt++)
-        {
-            if (lxhfs_driver_write(LXHFS_DATA_OFS(inode->dno[dno_cnt]), inode->data[dno_cnt],
-                                   LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+            /*出错的inode仍在脏链表表头，立即重试只会空转占锁：只报告一次，等一个tick再试*/
+            if (!failed)
             {
-                LXHFS_DBG("[%s] io error\n", __func__);
-                return -LXHFS_ERROR_IO;
+                LXHFS_DBG("[%s] writeback error %d, retrying every %ld ms\n", __func__, err, tick);
             }
+            failed = TRUE;
         }
-        int dno_cursor = 0;
-        boolean is_find_free_enough = FALSE;
-        for (int byte_cursor = 0; byte_cursor < LXHFS_BLKS_SZ(lxhfs_super.map_data_blks);
-             byte_cursor++)
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += tick / 1000;
+        deadline.tv_nsec += (tick % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
         {
-            for (int bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-            {
-                if ((lxhfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0)
-                {
-                    /* 当前dno_cursor位置空闲 */
-                    lxhfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-                    inode->dno[dno_cnt] = dno_cursor; /*为当前目录项分配data节点*/
-                    is_find_free_enough = TRUE;
-                    break;
-                }
-                dno_cursor++;
-            }
-            if (is_find_free_enough)
-            {
-                break;
-            }
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
         }
-        if (!is_find_free_enough || dno_cursor == lxhfs_super.max_data)
-            return -LXHFS_ERROR_NOSPACE;
+        pthread_cond_timedwait(&lxhfs_super.wb_cond, &lxhfs_super.lock, &deadline);
     }
-    return LXHFS_ERROR_NONE;
+    pthread_mutex_unlock(&lxhfs_super.lock);
+    return NULL;
 }
 
 /**
@@ -332,72 +2072,106 @@ struct lxhfs_inode *lxhfs_read_inode(struct lxhfs_dentry *dentry, int ino)
     struct lxhfs_inode *inode = (struct lxhfs_inode *)malloc(sizeof(struct lxhfs_inode));
     struct lxhfs_inode_d inode_d;
     struct lxhfs_dentry *sub_dentry;
-    struct lxhfs_dentry_d dentry_d;
-    int dir_cnt = 0, i, dno_cnt, off_cnt;
+    struct lxhfs_dentry_d *dentry_d;
+    uint8_t *blk_buf = (uint8_t *)malloc(LXHFS_BLK_SZ());
+    int dir_cnt = 0, i, off_cnt;
 
-    /*通过磁盘驱动来将磁盘中ino号的inode读入内存*/
-    if (lxhfs_driver_read(LXHFS_INO_OFS(ino), (uint8_t *)&inode_d,
-                          sizeof(struct lxhfs_inode_d)) != LXHFS_ERROR_NONE)
+    /*通过磁盘驱动来将磁盘中ino号的inode读入内存，连同内嵌的内容一起读；
+      同一块中的其他inode随块进入缓存，扫描目录时不再读盘*/
+    if (lxhfs_driver_read(LXHFS_INO_OFS(ino), blk_buf, LXHFS_INO_SZ()) != LXHFS_ERROR_NONE)
     {
         LXHFS_DBG("[%s] io error\n", __func__);
+        free(blk_buf);
         return NULL;
     }
+    memcpy(&inode_d, blk_buf, sizeof(struct lxhfs_inode_d));
     inode->dir_cnt = 0;
     inode->ino = inode_d.ino;
     inode->size = inode_d.size;
     inode->dentry = dentry;
     inode->dentrys = NULL;
-    for (dno_cnt = 0; dno_cnt < LXHFS_DATA_PER_FILE; dno_cnt++)
+    inode->dir_hash = NULL;
+    inode->dir_hash_sz = inode->dir_hash_cnt = 0;
+    inode->dir_partial = FALSE;
+    inode->dx_blks = 0;
+    inode->flags = 0;
+    inode->dirty_bytes = 0;
+    inode->dirty_prev = inode->dirty_next = NULL;
+    inode->res_cnt = 0;
+    inode->res_prev = inode->res_next = NULL;
+    inode->rsv_slot = -1;
+    inode->rsv_start = inode->rsv_len = 0;
+    inode->pend_blks = 0;
+    /*由区段建立逐块映射，文件数据在第一次读写时才读入*/
+    lxhfs_extent_init(inode);
+    if (lxhfs_extent_unpack(inode, &inode_d) != LXHFS_ERROR_NONE)
     {
-        inode->dno[dno_cnt] = inode_d.dno[dno_cnt];
+        LXHFS_DBG("[%s] io error\n", __func__);
+        free(blk_buf);
+        return NULL;
     }
 
     /*此处实现方式类似sync_icode，分两种文件类型分别讨论*/
-    /*若是目录类型*/
-    if (LXHFS_IS_DIR(inode))
+    /*内嵌的目录项和文件数据就在刚读入的inode块中*/
+    if ((inode_d.flags & LXHFS_INODE_INLINE) && LXHFS_IS_DIR(inode))
     {
-        dir_cnt = inode_d.dir_cnt;
-        dno_cnt = 0;
-        i = 0;
-        off_cnt = 0;
-        while (i < dir_cnt && dno_cnt < LXHFS_DATA_PER_FILE)
+        dentry_d = (struct lxhfs_dentry_d *)(blk_buf + sizeof(struct lxhfs_inode_d));
+        for (i = 0; i < inode_d.dir_cnt && i < LXHFS_INLINE_DENTRYS(); i++, dentry_d++)
         {
-            if (lxhfs_driver_read(LXHFS_DATA_OFS(inode->dno[dno_cnt]) + off_cnt * sizeof(struct lxhfs_dentry_d),
-                                  (uint8_t *)&dentry_d,
-                                  sizeof(struct lxhfs_dentry_d)) != LXHFS_ERROR_NONE)
-            {
-                LXHFS_DBG("[%s] io error\n", __func__);
-                return NULL;
-            }
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
+            sub_dentry = new_dentry(dentry_d->fname, dentry_d->ftype);
             sub_dentry->parent = inode->dentry;
-            sub_dentry->ino = dentry_d.ino;
+            sub_dentry->ino = dentry_d->ino;
             lxhfs_alloc_dentry(inode, sub_dentry);
-            i++;
-            off_cnt++;
-            /*如果一个数据块不够写，写到下一个数据块*/
-            if (LXHFS_DATA_OFS(inode->dno[dno_cnt]) + (off_cnt + 1) * sizeof(struct lxhfs_dentry_d) > LXHFS_DATA_OFS(inode->dno[dno_cnt] + 1))
-            {
-                dno_cnt++;
-                off_cnt = 0;
-            }
         }
     }
-    /*若是文件类型直接读取数据即可*/
-    else if (LXHFS_IS_REG(inode))
+    else if ((inode_d.flags & LXHFS_INODE_INLINE) && inode->size > 0)
     {
-        /*对于文件的每一个数据块分别进行读取*/
-        for (dno_cnt = 0; dno_cnt < LXHFS_DATA_PER_FILE; dno_cnt++)
+        lxhfs_extent_grow(inode, 1);
+        inode->data[0] = (uint8_t *)calloc(1, LXHFS_BLK_SZ());
+        memcpy(inode->data[0], blk_buf + sizeof(struct lxhfs_inode_d),
+               inode->size < LXHFS_INLINE_SZ() ? inode->size : LXHFS_INLINE_SZ());
+        inode->res_cnt++;
+        lxhfs_super.data_resident++;
+        lxhfs_data_touch(inode);
+    }
+    /*带索引的目录此时不读叶块，查找时按哈希读所在的叶块，遍历或增删时再全部读入*/
+    else if ((inode_d.flags & LXHFS_INODE_INDEXED) && LXHFS_IS_DIR(inode))
+    {
+        inode->dir_cnt = inode_d.dir_cnt;
+        inode->dir_partial = TRUE;
+        while (inode->dx_blks < inode->blk_cap && inode->dno[inode->dx_blks] != LXHFS_DNO_NONE)
+        {
+            inode->dx_blks++;
+        }
+    }
+    /*若是目录类型*/
+    else if (LXHFS_IS_DIR(inode))
+    {
+        /*与sync对称，每个目录块整块读一次，再逐项解析*/
+        dir_cnt = inode_d.dir_cnt;
+        i = 0;
+        while (i < dir_cnt && i / LXHFS_DENTRY_PER_BLK() < inode->blk_cap)
         {
-            inode->data[dno_cnt] = (uint8_t *)malloc(LXHFS_BLK_SZ());
-            if (lxhfs_driver_read(LXHFS_DATA_OFS(inode->dno[dno_cnt]), (uint8_t *)inode->data[dno_cnt],
+            off_cnt = i % LXHFS_DENTRY_PER_BLK();
+            if (off_cnt == 0 &&
+                lxhfs_driver_read(LXHFS_DATA_OFS(inode->dno[i / LXHFS_DENTRY_PER_BLK()]), blk_buf,
                                   LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
             {
                 LXHFS_DBG("[%s] io error\n", __func__);
+                free(blk_buf);
                 return NULL;
             }
+            dentry_d = (struct lxhfs_dentry_d *)blk_buf + off_cnt;
+            sub_dentry = new_dentry(dentry_d->fname, dentry_d->ftype);
+            sub_dentry->parent = inode->dentry;
+            sub_dentry->ino = dentry_d->ino;
+            lxhfs_alloc_dentry(inode, sub_dentry);
+            i++;
         }
     }
+    free(blk_buf);
+    /*刚从磁盘读入，与磁盘一致*/
+    lxhfs_mark_clean(inode);
     return inode;
 }
 
@@ -410,8 +2184,13 @@ struct lxhfs_inode *lxhfs_read_inode(struct lxhfs_dentry *dentry, int ino)
  */
 struct lxhfs_dentry *lxhfs_get_dentry(struct lxhfs_inode *inode, int dir)
 {
-    struct lxhfs_dentry *dentry_cursor = inode->dentrys;
+    struct lxhfs_dentry *dentry_cursor;
     int cnt = 0;
+    if (lxhfs_dir_load(inode) != LXHFS_ERROR_NONE)
+    {
+        return NULL;
+    }
+    dentry_cursor = inode->dentrys;
     while (dentry_cursor)
     {
         if (dir == cnt)
@@ -449,9 +2228,8 @@ struct lxhfs_dentry *lxhfs_lookup(const char *path, boolean *is_find, boolean *i
     int lvl = 0;
     boolean is_hit;
     char *fname = NULL;
-    char *path_cpy = (char *)malloc(sizeof(path));
+    char *path_cpy = strdup(path); /*分析路径函数*/
     *is_root = FALSE;
-    strcpy(path_cpy, path); /*分析路径函数*/
 
     if (total_lvl == 0)
     { /* 根目录 */
@@ -465,7 +2243,7 @@ struct lxhfs_dentry *lxhfs_lookup(const char *path, boolean *is_find, boolean *i
         lvl++;
         if (dentry_cursor->inode == NULL)
         { /* Cache机制 */
-            lxhfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            dentry_cursor->inode = lxhfs_read_inode(dentry_cursor, dentry_cursor->ino);
         }
         inode = dentry_cursor->inode;
         /*若遍历到的inode节点是FILE类型，则结束遍历*/
@@ -478,17 +2256,14 @@ struct lxhfs_dentry *lxhfs_lookup(const char *path, boolean *is_find, boolean *i
         /*若遍历到的inode节点是目录类型*/
         if (LXHFS_IS_DIR(inode))
         {
-            dentry_cursor = inode->dentrys;
-            is_hit = FALSE;
-            while (dentry_cursor)
+            /*按文件名哈希查找；带索引的目录只读入了部分叶块时，再读哈希所在的叶块*/
+            dentry_cursor = lxhfs_dir_find(inode, fname);
+            if (dentry_cursor == NULL && inode->dir_partial &&
+                lxhfs_dir_probe(inode, fname) == LXHFS_ERROR_NONE)
             {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0)
-                {
-                    is_hit = TRUE;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother; /*遍历目录的子文件*/
+                dentry_cursor = lxhfs_dir_find(inode, fname);
             }
+            is_hit = dentry_cursor != NULL;
             /*未找到匹配路径*/
             if (!is_hit)
             {
@@ -513,6 +2288,7 @@ struct lxhfs_dentry *lxhfs_lookup(const char *path, boolean *is_find, boolean *i
         dentry_ret->inode = lxhfs_read_inode(dentry_ret, dentry_ret->ino);
     }
 
+    free(path_cpy);
     return dentry_ret;
 }
 
@@ -520,11 +2296,11 @@ struct lxhfs_dentry *lxhfs_lookup(const char *path, boolean *is_find, boolean *i
  * @brief 挂载lxhfs, Layout 如下
  *
  * Layout
- * | Super | Inode Map | Data |
+ * | Super | Inode Map | Data Map | Journal | Inode | Data |
  *
- * BLK_SZ = 2*Inode_SZ
+ * BLK_SZ = 4*Inode_SZ
  *
- * 每个Inode占用一个Blk
+ * 每个Blk紧密存放BLK_SZ / LXHFS_INODE_SZ个Inode
  * @param options
  * @return int
  */
@@ -537,15 +2313,26 @@ int lxhfs_mount(struct custom_options options)
     struct lxhfs_dentry *root_dentry;
     struct lxhfs_inode *root_inode;
 
-    int inode_num;
-    int data_num;
-    int map_inode_blks;
-    int map_data_blks;
-
-    int super_blks;
-    boolean is_init = FALSE;
+    uint64_t sz_io;
+    uint8_t *io_buf;
 
     lxhfs_super.is_mounted = FALSE;
+    lxhfs_super.is_dirty = FALSE;
+    lxhfs_super.dirty_head = lxhfs_super.dirty_tail = NULL;
+    lxhfs_super.dirty_inodes = 0;
+    lxhfs_super.dirty_bytes = 0;
+    lxhfs_super.wb_running = FALSE;
+    lxhfs_super.wb_rounds = 0;
+    lxhfs_super.wb_age = options.wb_age;
+    lxhfs_super.wb_bytes = options.wb_bytes;
+    lxhfs_super.wb_inodes = options.wb_inodes;
+    lxhfs_super.wb_io = options.wb_io;
+    lxhfs_super.jnl_cnt = lxhfs_super.jnl_revoke_cnt = 0;
+    lxhfs_super.data_limit = options.data_blks;
+    lxhfs_super.data_resident = 0;
+    lxhfs_super.res_head = lxhfs_super.res_tail = NULL;
+    lxhfs_super.data_faults = lxhfs_super.data_evicts = 0;
+    lxhfs_super.jnl_commits = lxhfs_super.jnl_logged = lxhfs_super.jnl_checkpoints = 0;
 
     // driver_fd = open(options.device, O_RDWR);
     driver_fd = ddriver_open(options.device); /*打开驱动*/
@@ -558,59 +2345,79 @@ int lxhfs_mount(struct custom_options options)
     /* 向内存超级块中标记驱动并写入磁盘大小和单次IO大小*/
     lxhfs_super.driver_fd = driver_fd;
     ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_DEVICE_SIZE, &lxhfs_super.sz_disk);
-    ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &lxhfs_super.sz_io);
-    /*ext2文件系统块大小1024B*/
-    lxhfs_super.sz_blk = 2 * lxhfs_super.sz_io;
-    /*创建根目录项并读取磁盘超级块到内存*/
-    root_dentry = new_dentry("/", LXHFS_DIR);
-
-    if (lxhfs_driver_read(LXHFS_SUPER_OFS, (uint8_t *)(&lxhfs_super_d),
-                          sizeof(struct lxhfs_super_d)) != LXHFS_ERROR_NONE)
+    ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &sz_io);
+    lxhfs_super.sz_io = (int)sz_io;
+    /*块大小记在超级块中，超级块直接从设备读，之后才能建立块缓存*/
+    io_buf = (uint8_t *)malloc(LXHFS_IO_SZ());
+    if (ddriver_pread(LXHFS_DRIVER(), (char *)io_buf, LXHFS_IO_SZ(), LXHFS_SUPER_OFS) != LXHFS_IO_SZ())
     {
+        free(io_buf);
         return -LXHFS_ERROR_IO;
     }
+    memcpy(&lxhfs_super_d, io_buf, sizeof(struct lxhfs_super_d));
+    free(io_buf);
 
-    /*根据超级块幻数判断是否为第一次启动磁盘，如果是第一次启动磁盘，则需要建立磁盘超级块的布局*/
-    /* 读取super */
+    /*旧格式的磁盘无法按当前格式解析，也不能当作空盘格式化掉*/
+    if (lxhfs_super_d.magic_num == LXHFS_MAGIC_NUM_V1)
+    {
+        LXHFS_DBG("[%s] unsupported old disk format, reformat with mkfs.lxhfs\n", __func__);
+        ddriver_close(driver_fd);
+        return -LXHFS_ERROR_UNSUPPORTED;
+    }
+    /*根据超级块幻数判断是否为第一次启动磁盘，如果是，按设备大小格式化*/
     if (lxhfs_super_d.magic_num != LXHFS_MAGIC_NUM)
-    { /* 幻数无 */
-
-        /* 为了简单起见，我们可以自行 规定位图 的大小 */
-        super_blks = 1;
-        inode_num = 128;
-        data_num = 512;
-        map_inode_blks = 1;
-        map_data_blks = 1;
-
-        /* 布局layout */
-        lxhfs_super.max_ino = inode_num;
-        lxhfs_super.max_data = data_num;
-
-        lxhfs_super_d.map_inode_offset = LXHFS_SUPER_OFS + LXHFS_BLKS_SZ(super_blks);
-        lxhfs_super_d.map_data_offset = lxhfs_super_d.map_inode_offset + LXHFS_BLKS_SZ(map_inode_blks);
-        lxhfs_super_d.inode_offset = lxhfs_super_d.map_data_offset + LXHFS_BLKS_SZ(map_data_blks);
-        lxhfs_super_d.data_offset = lxhfs_super_d.inode_offset + LXHFS_BLKS_SZ(inode_num);
+    {
+        if (lxhfs_mkfs_layout(&lxhfs_super_d, lxhfs_super.sz_disk, 2 * LXHFS_IO_SZ(),
+                              LXHFS_DEFAULT_INODE_RATIO, LXHFS_DEFAULT_GROUP_BLKS) != LXHFS_ERROR_NONE ||
+            lxhfs_mkfs(LXHFS_DRIVER(), &lxhfs_super_d) != LXHFS_ERROR_NONE)
+        {
+            return -LXHFS_ERROR_IO;
+        }
+        LXHFS_DBG("inode map blocks: %d\n", lxhfs_super_d.map_inode_blks);
+    }
 
-        lxhfs_super_d.map_inode_blks = map_inode_blks;
-        lxhfs_super_d.map_data_blks = map_data_blks;
+    lxhfs_super.sz_blk = lxhfs_super_d.sz_blk;
+    /*mmap模式直接读写映射的镜像，不另设块缓存*/
+    if (lxhfs_buf_init(options.use_mmap ? 0 : options.cache_blks) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    root_dentry = new_dentry("/", LXHFS_DIR);
 
-        lxhfs_super_d.magic_num = LXHFS_MAGIC_NUM;
-        lxhfs_super_d.sz_usage = 0;
-        LXHFS_DBG("inode map blocks: %d\n", map_inode_blks);
-        is_init = TRUE;
+    /*上次没有正常卸载时，日志中已提交的元数据还未写回原位，重放后重新读超级块*/
+    if (lxhfs_super_d.journal_blks > 0 &&
+        (lxhfs_journal_replay(lxhfs_super_d.journal_offset, lxhfs_super_d.journal_blks) < 0 ||
+         lxhfs_driver_read(LXHFS_SUPER_OFS, (uint8_t *)(&lxhfs_super_d),
+                           sizeof(struct lxhfs_super_d)) != LXHFS_ERROR_NONE))
+    {
+        return -LXHFS_ERROR_IO;
     }
 
     /*初始化内存中的超级块，和根目录项*/
     lxhfs_super.sz_usage = lxhfs_super_d.sz_usage; /* 建立 in-memory 结构 */
+    lxhfs_super.max_ino = lxhfs_super_d.max_ino;
+    lxhfs_super.max_data = lxhfs_super_d.max_data;
 
     lxhfs_super.map_inode = (uint8_t *)malloc(LXHFS_BLKS_SZ(lxhfs_super_d.map_inode_blks));
     lxhfs_super.map_data = (uint8_t *)malloc(LXHFS_BLKS_SZ(lxhfs_super_d.map_data_blks));
+    lxhfs_super.map_discard = (uint8_t *)calloc(1, LXHFS_BLKS_SZ(lxhfs_super_d.map_data_blks));
+    lxhfs_super.has_discard = FALSE;
     lxhfs_super.map_inode_blks = lxhfs_super_d.map_inode_blks;
     lxhfs_super.map_data_blks = lxhfs_super_d.map_data_blks;
     lxhfs_super.map_inode_offset = lxhfs_super_d.map_inode_offset;
     lxhfs_super.map_data_offset = lxhfs_super_d.map_data_offset;
     lxhfs_super.inode_offset = lxhfs_super_d.inode_offset;
+    lxhfs_super.sz_inode = lxhfs_super_d.sz_inode;
+    lxhfs_super.inode_blks = lxhfs_super_d.inode_blks;
     lxhfs_super.data_offset = lxhfs_super_d.data_offset;
+    lxhfs_super.journal_offset = lxhfs_super_d.journal_offset;
+    lxhfs_super.journal_blks = lxhfs_super_d.journal_blks;
+    lxhfs_super.group_desc_offset = lxhfs_super_d.group_desc_offset;
+    lxhfs_super.group_desc_blks = lxhfs_super_d.group_desc_blks;
+    lxhfs_super.group_cnt = lxhfs_super_d.group_cnt;
+    lxhfs_super.group_inodes = lxhfs_super_d.group_inodes;
+    lxhfs_super.group_data = lxhfs_super_d.group_data;
+    lxhfs_super.group_stride = LXHFS_BLKS_SZ((uint64_t)(lxhfs_super.inode_blks + lxhfs_super.group_data));
 
     if (lxhfs_driver_read(lxhfs_super_d.map_inode_offset, (uint8_t *)(lxhfs_super.map_inode),
                           LXHFS_BLKS_SZ(lxhfs_super_d.map_inode_blks)) != LXHFS_ERROR_NONE)
@@ -622,11 +2429,23 @@ int lxhfs_mount(struct custom_options options)
     {
         return -LXHFS_ERROR_IO;
     }
-
-    if (is_init)
-    { /* 分配根节点 */
-        root_inode = lxhfs_alloc_inode(root_dentry);
-        lxhfs_sync_inode(root_inode); /*将根节点写回磁盘*/
+    if (lxhfs_bitmap_init(&lxhfs_super.bm_inode, lxhfs_super.map_inode, lxhfs_super.max_ino) != LXHFS_ERROR_NONE ||
+        lxhfs_bitmap_init(&lxhfs_super.bm_data, lxhfs_super.map_data, lxhfs_super.max_data) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    if (lxhfs_bitmap_track(&lxhfs_super.bm_inode, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE ||
+        lxhfs_bitmap_track(&lxhfs_super.bm_data, LXHFS_BLK_SZ()) != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_NOSPACE;
+    }
+    lxhfs_super.bm_data.seg = lxhfs_super.group_data; /* 相邻块组的数据片不连续 */
+    memset(lxhfs_super.rsv_owner, 0, sizeof(lxhfs_super.rsv_owner));
+    lxhfs_super.rsv_next = 0;
+    lxhfs_super.pend_blks = 0;
+    if (lxhfs_group_init() != LXHFS_ERROR_NONE)
+    {
+        return -LXHFS_ERROR_IO;
     }
 
     root_inode = lxhfs_read_inode(root_dentry, LXHFS_ROOT_INO);
@@ -634,9 +2453,43 @@ int lxhfs_mount(struct custom_options options)
     lxhfs_super.root_dentry = root_dentry;
     lxhfs_super.is_mounted = TRUE;
 
+    /*FUSE回调与刷写线程共用一把锁*/
+    pthread_mutex_init(&lxhfs_super.lock, NULL);
+    pthread_cond_init(&lxhfs_super.wb_cond, NULL);
+    if (lxhfs_super.wb_age > 0)
+    {
+        lxhfs_super.wb_running = TRUE;
+        if (pthread_create(&lxhfs_super.wb_thread, NULL, lxhfs_writeback_thread, NULL) != 0)
+        {
+            lxhfs_super.wb_running = FALSE;
+        }
+    }
+
     return ret;
 }
 
+/**
+ * @brief 打印本次挂载的统计，由--stats打开
+ */
+static void lxhfs_print_stats()
+{
+    if (lxhfs_super.buf_cnt > 0)
+    {
+        LXHFS_DBG("buffer cache: hit %lu, miss %lu, evict %lu, writeback %lu\n",
+                  lxhfs_super.buf_hit, lxhfs_super.buf_miss, lxhfs_super.buf_evict, lxhfs_super.buf_writeback);
+    }
+    LXHFS_DBG("writeback: %lu background rounds\n", lxhfs_super.wb_rounds);
+    LXHFS_DBG("file data: %lu blocks faulted in, %lu evicted, %d resident\n",
+              lxhfs_super.data_faults, lxhfs_super.data_evicts, lxhfs_super.data_resident);
+    LXHFS_DBG("free: %d inodes, %d data blocks in %d groups\n",
+              lxhfs_super.bm_inode.nfree, lxhfs_super.bm_data.nfree, lxhfs_super.group_cnt);
+    if (lxhfs_super.journal_blks > 0)
+    {
+        LXHFS_DBG("journal: %lu commits, %lu blocks logged, %lu checkpoints\n",
+                  lxhfs_super.jnl_commits, lxhfs_super.jnl_logged, lxhfs_super.jnl_checkpoints);
+    }
+}
+
 /**
  * @brief
  *
@@ -644,49 +2497,59 @@ int lxhfs_mount(struct custom_options options)
  */
 int lxhfs_umount()
 {
-    struct lxhfs_super_d lxhfs_super_d;
-
+    int ret;
     if (!lxhfs_super.is_mounted)
     {
         return LXHFS_ERROR_NONE;
     }
 
-    lxhfs_sync_inode(lxhfs_super.root_dentry->inode); /* 从根节点向下刷写节点 */
-
-    /*将内存超级块转换为磁盘超级块并写入磁盘*/
-    lxhfs_super_d.magic_num = LXHFS_MAGIC_NUM;
-    lxhfs_super_d.map_inode_blks = lxhfs_super.map_inode_blks;
-    lxhfs_super_d.map_data_blks = lxhfs_super.map_data_blks;
-    lxhfs_super_d.map_inode_offset = lxhfs_super.map_inode_offset;
-    lxhfs_super_d.map_data_offset = lxhfs_super.map_data_offset;
-    lxhfs_super_d.inode_offset = lxhfs_super.inode_offset;
-    lxhfs_super_d.data_offset = lxhfs_super.data_offset;
-    lxhfs_super_d.sz_usage = lxhfs_super.sz_usage;
-
-    if (lxhfs_driver_write(LXHFS_SUPER_OFS, (uint8_t *)&lxhfs_super_d,
-                           sizeof(struct lxhfs_super_d)) != LXHFS_ERROR_NONE)
+    /*先停下刷写线程，剩下的脏数据由卸载一次写完*/
+    pthread_mutex_lock(&lxhfs_super.lock);
+    if (lxhfs_super.wb_running)
     {
-        return -LXHFS_ERROR_IO;
+        lxhfs_super.wb_running = FALSE;
+        pthread_cond_signal(&lxhfs_super.wb_cond);
+        pthread_mutex_unlock(&lxhfs_super.lock);
+        pthread_join(lxhfs_super.wb_thread, NULL);
+    }
+    else
+    {
+        pthread_mutex_unlock(&lxhfs_super.lock);
     }
 
-    /*将inode位图和data位图写入磁盘*/
-    if (lxhfs_driver_write(lxhfs_super_d.map_inode_offset, (uint8_t *)(lxhfs_super.map_inode),
-                           LXHFS_BLKS_SZ(lxhfs_super_d.map_inode_blks)) != LXHFS_ERROR_NONE)
+    /*剩下的修改作为最后一个事务提交，再做检查点，正常卸载后日志区为空。
+      有文件分配不到块时其余修改已经提交，卸载照常完成，最后返回该错误*/
+    ret = lxhfs_writeback(-1);
+    if ((ret != LXHFS_ERROR_NONE && ret != -LXHFS_ERROR_NOSPACE) ||
+        lxhfs_journal_checkpoint() != LXHFS_ERROR_NONE)
     {
         return -LXHFS_ERROR_IO;
     }
 
-    if (lxhfs_driver_write(lxhfs_super_d.map_data_offset, (uint8_t *)(lxhfs_super.map_data),
-                           LXHFS_BLKS_SZ(lxhfs_super_d.map_data_blks)) != LXHFS_ERROR_NONE)
+    /*设备可能带易失写缓存，卸载前要求其落盘*/
+    if (ddriver_ioctl(LXHFS_DRIVER(), IOC_REQ_FLUSH, NULL) < 0)
     {
         return -LXHFS_ERROR_IO;
     }
 
+    lxhfs_rsv_drop_all();
+    if (lxhfs_options.show_stats)
+    {
+        lxhfs_print_stats();
+    }
+    lxhfs_journal_destroy();
+    pthread_cond_destroy(&lxhfs_super.wb_cond);
+    pthread_mutex_destroy(&lxhfs_super.lock);
+    lxhfs_buf_destroy();
+    lxhfs_bitmap_destroy(&lxhfs_super.bm_inode);
+    lxhfs_bitmap_destroy(&lxhfs_super.bm_data);
+    lxhfs_group_destroy();
     free(lxhfs_super.map_inode);
     free(lxhfs_super.map_data);
+    free(lxhfs_super.map_discard);
 
     /*关闭驱动*/
     ddriver_close(LXHFS_DRIVER());
 
-    return LXHFS_ERROR_NONE;
+    return ret;
 }
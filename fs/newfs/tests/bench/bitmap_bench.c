@@ -0,0 +1,144 @@
+#include "lxhfs.h"
+#include <sys/time.h>
+
+/*
+ * 位图分配速率随填充率的变化：每填满10%统计一次分配速率。
+ * old为原来逐位从头扫描的首次适配，new为lxhfs_bitmap的按字next-fit分配。
+ * 最后比较碎片化位图上逐块分配和整段分配得到的区段数
+ */
+
+#define BENCH_STEPS     10
+#define BENCH_OLD_MAX   (64 * 1024)          /* 逐位扫描是O(n^2)，只在小位图上对比 */
+#define BENCH_FILE_BLKS 64                   /* 区段数对比中每个文件的块数 */
+
+static long bench_now_us() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+/**
+ * @brief 原来的分配方式：每次从第0字节开始逐位找空闲位
+ */
+static int bench_old_alloc(uint8_t* map, int nbits) {
+	int byte_cursor, bit_cursor, cursor = 0;
+	for (byte_cursor = 0; byte_cursor < (nbits + UINT8_BITS - 1) / UINT8_BITS; byte_cursor++) {
+		for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
+			if (cursor == nbits)
+				return -LXHFS_ERROR_NOSPACE;
+			if ((map[byte_cursor] & (0x1 << bit_cursor)) == 0) {
+				map[byte_cursor] |= (0x1 << bit_cursor);
+				return cursor;
+			}
+			cursor++;
+		}
+	}
+	return -LXHFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief 从空位图填到满，打印每一段的分配速率(百万次/秒)
+ */
+static void bench_fill(int nbits, boolean is_old) {
+	uint8_t* map = (uint8_t*)calloc(1, (nbits + UINT64_BITS - 1) / UINT64_BITS * sizeof(uint64_t));
+	struct lxhfs_bitmap bm;
+	int step, i, per = nbits / BENCH_STEPS;
+	long start;
+
+	if (!is_old)
+		lxhfs_bitmap_init(&bm, map, nbits);
+	printf("%-4s %9d bits |", is_old ? "old" : "new", nbits);
+	for (step = 0; step < BENCH_STEPS; step++) {
+		start = bench_now_us();
+		for (i = 0; i < per; i++) {
+			if ((is_old ? bench_old_alloc(map, nbits) : lxhfs_bitmap_alloc(&bm)) < 0)
+				break;
+		}
+		printf(" %7.2f", (double)per / (bench_now_us() - start + 1));
+	}
+	printf("\n");
+	if (!is_old)
+		lxhfs_bitmap_destroy(&bm);
+	free(map);
+}
+
+/**
+ * @brief 填到90%后随机释放再分配，模拟长期使用后碎片化的位图
+ */
+static void bench_churn(int nbits, int rounds) {
+	uint8_t* map = (uint8_t*)calloc(1, (nbits + UINT64_BITS - 1) / UINT64_BITS * sizeof(uint64_t));
+	struct lxhfs_bitmap bm;
+	int i, bit;
+	long start;
+
+	lxhfs_bitmap_init(&bm, map, nbits);
+	for (i = 0; i < nbits / 10 * 9; i++)
+		lxhfs_bitmap_alloc(&bm);
+	srand(1);
+	start = bench_now_us();
+	for (i = 0; i < rounds; i++) {
+		do {
+			bit = rand() % nbits;
+		} while (!lxhfs_bitmap_test(&bm, bit));
+		lxhfs_bitmap_clear(&bm, bit);
+		lxhfs_bitmap_alloc(&bm);
+	}
+	printf("churn %9d bits at 90%%: %.2f M free+alloc/s, free %d\n",
+		   nbits, (double)rounds / (bench_now_us() - start + 1), bm.nfree);
+	lxhfs_bitmap_destroy(&bm);
+	free(map);
+}
+
+/**
+ * @brief 把位图随机填到一半制造碎片，再分配nfiles个BENCH_FILE_BLKS块的文件，
+ *        打印每个文件平均的区段数。逐块分配时每块的目标是前一块之后，整段分配一次要够整个文件
+ */
+static void bench_extents(int nbits, int nfiles, boolean is_run) {
+	uint8_t* map = (uint8_t*)calloc(1, (nbits + UINT64_BITS - 1) / UINT64_BITS * sizeof(uint64_t));
+	struct lxhfs_bitmap bm;
+	int i, blk, bit, prev, got, extents = 0;
+
+	lxhfs_bitmap_init(&bm, map, nbits);
+	srand(2);
+	while (bm.nfree > nbits / 2)
+		lxhfs_bitmap_set(&bm, rand() % nbits);
+	for (i = 0; i < nfiles; i++) {
+		prev = -2;
+		for (blk = 0; blk < BENCH_FILE_BLKS; blk += got) {
+			got = 1;
+			bit = is_run ? lxhfs_bitmap_alloc_run(&bm, prev + 1, BENCH_FILE_BLKS - blk, &got)
+						 : lxhfs_bitmap_alloc_goal(&bm, prev + 1);
+			if (bit < 0)
+				break;
+			if (bit != prev + 1)
+				extents++;
+			prev = bit + got - 1;
+		}
+	}
+	printf("%-5s %9d bits at 50%%: %.2f extents per %d-block file\n",
+		   is_run ? "run" : "block", nbits, (double)extents / nfiles, BENCH_FILE_BLKS);
+	lxhfs_bitmap_destroy(&bm);
+	free(map);
+}
+
+int main(int argc, char **argv)
+{
+	int sizes[] = { 4096, 32768, 1 << 20, 1 << 24 };
+	int i, step;
+
+	printf("allocation rate in M allocs/s per 10%% of fill\n");
+	printf("                   |");
+	for (step = 0; step < BENCH_STEPS; step++)
+		printf("  %3d%%+ ", step * 10);
+	printf("\n");
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		if (sizes[i] <= BENCH_OLD_MAX)
+			bench_fill(sizes[i], TRUE);
+		bench_fill(sizes[i], FALSE);
+	}
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+		bench_churn(sizes[i], 100000);
+	bench_extents(1 << 20, 1000, FALSE);
+	bench_extents(1 << 20, 1000, TRUE);
+	return 0;
+}
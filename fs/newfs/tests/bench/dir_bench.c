@@ -0,0 +1,121 @@
+#include "lxhfs.h"
+#include <sys/time.h>
+
+/*
+ * 目录查找随目录大小的变化。old为原来顺着brother链表逐个strcmp，new为按文件名哈希分桶。
+ * 再按1K块建出磁盘索引，比较冷查找一个文件名要读的目录块数：
+ * 线性目录平均要读一半的目录块，带索引的目录只读索引和一个叶块
+ */
+
+#define BENCH_LOOKUPS   200000
+#define BENCH_OLD_MAX   (4L << 20)           /* 逐个比较是O(n)，大目录上限制比较的总项数 */
+#define BENCH_SZ_BLK    1024
+
+static long bench_now_us() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+/**
+ * @brief 原来的查找方式：从链表头逐个比较文件名
+ */
+static struct lxhfs_dentry* bench_old_find(struct lxhfs_inode* inode, const char* fname) {
+	struct lxhfs_dentry* dentry;
+	for (dentry = inode->dentrys; dentry != NULL; dentry = dentry->brother) {
+		if (strcmp(dentry->fname, fname) == 0)
+			return dentry;
+	}
+	return NULL;
+}
+
+/**
+ * @brief 顺着索引找文件名所在的叶块，数读过的块并确认文件名在叶块中
+ *
+ * @return int 读过的块数，叶块中没有该文件名时返回-1
+ */
+static int bench_dx_walk(uint8_t* buf, const char* fname) {
+	struct lxhfs_dentry_d* dentry_d;
+	uint32_t hash = lxhfs_dir_hash(fname);
+	int blk = 0, reads = 0, levels, i;
+
+	do {
+		reads++;
+		levels = ((struct lxhfs_dx_head*)(buf + blk * BENCH_SZ_BLK))->levels;
+		blk = lxhfs_dx_next(buf + blk * BENCH_SZ_BLK, hash);
+	} while (blk >= 0 && levels-- > 0);
+	if (blk < 0)
+		return -1;
+	reads++;
+	dentry_d = (struct lxhfs_dentry_d*)(buf + blk * BENCH_SZ_BLK);
+	for (i = 0; i < BENCH_SZ_BLK / (int)sizeof(struct lxhfs_dentry_d); i++, dentry_d++) {
+		if (dentry_d->valid && strcmp(dentry_d->fname, fname) == 0)
+			return reads;
+	}
+	return -1;
+}
+
+static void bench_dir(int n) {
+	struct lxhfs_inode inode;
+	struct lxhfs_dentry* dentry;
+	char fname[LXHFS_MAX_FILE_NAME];
+	int per_blk = BENCH_SZ_BLK / (int)sizeof(struct lxhfs_dentry_d);
+	int old_lookups = BENCH_OLD_MAX / n < BENCH_LOOKUPS ? (int)(BENCH_OLD_MAX / n) : BENCH_LOOKUPS;
+	int i, blks = 0, reads, miss = 0;
+	long start, old_us, new_us, total_reads = 0;
+	uint8_t* buf;
+
+	memset(&inode, 0, sizeof(inode));
+	for (i = 0; i < n; i++) {
+		sprintf(fname, "file_%d", i);
+		lxhfs_dir_add(&inode, new_dentry(fname, LXHFS_REG_FILE));
+	}
+	inode.dir_cnt = n;
+
+	srand(3);
+	start = bench_now_us();
+	for (i = 0; i < old_lookups; i++) {
+		sprintf(fname, "file_%d", rand() % n);
+		miss += bench_old_find(&inode, fname) == NULL;
+	}
+	old_us = bench_now_us() - start;
+	srand(3);
+	start = bench_now_us();
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		sprintf(fname, "file_%d", rand() % n);
+		miss += lxhfs_dir_find(&inode, fname) == NULL;
+	}
+	new_us = bench_now_us() - start;
+
+	buf = lxhfs_dx_build(&inode, BENCH_SZ_BLK, &blks);
+	for (i = 0; i < n && buf != NULL; i++) {
+		sprintf(fname, "file_%d", i);
+		reads = bench_dx_walk(buf, fname);
+		if (reads < 0)
+			miss++;
+		else
+			total_reads += reads;
+	}
+	printf("%7d entries | old %9.1f ns | new %6.1f ns | linear %5d blks, %7.1f reads | indexed %5d blks, %4.1f reads | miss %d\n",
+		   n, old_us * 1000.0 / old_lookups, new_us * 1000.0 / BENCH_LOOKUPS,
+		   (n + per_blk - 1) / per_blk, ((n + per_blk - 1) / per_blk + 1) / 2.0,
+		   buf != NULL ? blks : 0, buf != NULL ? (double)total_reads / n : 0.0, miss);
+
+	free(buf);
+	while ((dentry = inode.dentrys) != NULL) {
+		lxhfs_dir_remove(&inode, dentry);
+		free(dentry);
+	}
+	lxhfs_dir_destroy(&inode);
+}
+
+int main(int argc, char **argv)
+{
+	int sizes[] = { 10, 1000, 100000 };
+	int i;
+
+	printf("lookup time per name; cold-lookup directory blocks read with %d-byte blocks\n", BENCH_SZ_BLK);
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+		bench_dir(sizes[i]);
+	return 0;
+}
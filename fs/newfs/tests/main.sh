@@ -3,8 +3,8 @@ POINTS=0
 TOTAL_POINTS=0
 TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh)
 # mount.sh mkdir.sh touch.sh ls.sh remount.sh (read.sh write.sh cp.sh)
-ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
-ALL_TEST_SCORES=(1 4 5 4 16 2 2)
+ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh flush.sh journal.sh extent.sh bigdir.sh)
+ALL_TEST_SCORES=(1 4 5 4 16 2 2 1 1 1 1)
 MNTPOINT='./mnt'
 PROJECT_NAME="lxhfs"
 
@@ -29,11 +29,11 @@ elif [[ "${LEVEL}" == "4" ]]; then
     sleep 1
 elif [[ "${LEVEL}" == "5" ]]; then
     echo "开始mount, mkdir, touch, ls, read&write, umount测试"
-    TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh)
+    TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh flush.sh journal.sh extent.sh bigdir.sh)
     sleep 1
 elif [[ "${LEVEL}" == "6" ]]; then
     echo "开始mount, mkdir, touch, ls, read&write, cp, umount测试"
-    TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
+    TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh flush.sh journal.sh extent.sh bigdir.sh)
     sleep 1
 else
     echo "未知测试参数"
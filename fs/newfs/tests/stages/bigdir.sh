@@ -0,0 +1,40 @@
+#!/bin/bash
+
+TEST_CASE="case 11 - large directory"
+
+# 超过一个块的目录带哈希索引，重新挂载后逐个按名查找并完整列出
+function check_bigdir () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    for i in $(seq 0 99); do
+        if ! touch "$_PARAM"/file_"$i"; then
+            fail "$_TEST_CASE: 在$_PARAM下创建file_$i失败"
+            return 1
+        fi
+    done
+    sleep 1
+    umount "${MNTPOINT}"
+    sleep 1
+    try_mount_or_fail
+    for i in $(seq 99 -1 0); do
+        if [[ ! -f "$_PARAM"/file_"$i" ]]; then
+            fail "$_TEST_CASE: 重新挂载后$_PARAM/file_$i不存在"
+            return 1
+        fi
+    done
+    if [[ -e "$_PARAM"/file_100 ]]; then
+        fail "$_TEST_CASE: 重新挂载后$_PARAM下出现了不存在的file_100"
+        return 1
+    fi
+    if [[ "$(ls "$_PARAM" | wc -l)" -ne 100 ]]; then
+        fail "$_TEST_CASE: 重新挂载后$_PARAM下的文件数不是100"
+        return 1
+    fi
+    return 0
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 11.1 - ${MNTPOINT}/bigdir with 100 files survives remount"
+core_tester mkdir "${MNTPOINT}"/bigdir check_bigdir "$TEST_CASE"
@@ -0,0 +1,93 @@
+#!/bin/bash
+
+TEST_CASE="case 10 - large file"
+
+# 超过16个数据块的文件，重新挂载后由区段映射读回
+function check_large () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    _GOLDEN=$(mktemp)
+
+    head -c 65536 /dev/urandom > "$_GOLDEN"
+    if ! cp "$_GOLDEN" "$_PARAM"; then
+        fail "$_TEST_CASE: 写入64KB到文件$_PARAM失败"
+        rm -f "$_GOLDEN"
+        return 1
+    fi
+    sleep 1
+    umount "${MNTPOINT}"
+    sleep 1
+    try_mount_or_fail
+    if ! cmp -s "$_GOLDEN" "$_PARAM"; then
+        fail "$_TEST_CASE: 重新挂载后文件$_PARAM的内容不同"
+        rm -f "$_GOLDEN"
+        return 1
+    fi
+    rm -f "$_GOLDEN"
+    return 0
+}
+
+# 只用truncate增长、从未写过的小文件内嵌在inode中，卸载后读回全0
+function check_truncated () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    if ! truncate -s 100 "$_PARAM"; then
+        fail "$_TEST_CASE: 把文件$_PARAM截断到100字节失败"
+        return 1
+    fi
+    sleep 1
+    umount "${MNTPOINT}"
+    sleep 1
+    try_mount_or_fail
+    if [[ "$(stat -c %s "$_PARAM" 2>/dev/null)" != "100" ]] ||
+       ! cmp -s <(head -c 100 /dev/zero) "$_PARAM"; then
+        fail "$_TEST_CASE: 重新挂载后文件$_PARAM不是100字节的0"
+        return 1
+    fi
+    return 0
+}
+
+# 写回后截断到0再删除的文件，预留窗口随之收回，之后写回的文件重新挂载后完整
+function check_truncate_unlink () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    _GOLDEN=$(mktemp)
+
+    head -c 8192 /dev/urandom > "$_GOLDEN"
+    cp "$_GOLDEN" "$_PARAM"
+    # 等待后台刷写线程分配数据块和预留窗口(默认脏数据最长停留5s)
+    sleep 7
+    if ! truncate -s 0 "$_PARAM" || ! rm "$_PARAM"; then
+        fail "$_TEST_CASE: 截断并删除文件$_PARAM失败"
+        rm -f "$_GOLDEN"
+        return 1
+    fi
+    for i in $(seq 0 9); do
+        cp "$_GOLDEN" "$_PARAM"_$i
+    done
+    sleep 7
+    umount "${MNTPOINT}"
+    sleep 1
+    try_mount_or_fail
+    for i in $(seq 0 9); do
+        if ! cmp -s "$_GOLDEN" "$_PARAM"_$i; then
+            fail "$_TEST_CASE: 重新挂载后文件${_PARAM}_$i的内容不同"
+            rm -f "$_GOLDEN"
+            return 1
+        fi
+    done
+    rm -f "$_GOLDEN"
+    return 0
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 10.1 - 64KB ${MNTPOINT}/large survives remount"
+core_tester touch "${MNTPOINT}"/large check_large "$TEST_CASE"
+
+TEST_CASE="case 10.2 - ${MNTPOINT}/sparse grown by truncate survives remount"
+core_tester touch "${MNTPOINT}"/sparse check_truncated "$TEST_CASE"
+
+TEST_CASE="case 10.3 - ${MNTPOINT}/shrunk truncated to 0 and removed after writeback"
+core_tester touch "${MNTPOINT}"/shrunk check_truncate_unlink "$TEST_CASE"
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+TEST_CASE="case 8 - flush io"
+
+# 本次挂载期间设备的读请求数，由ddriver在关闭时记入日志
+function session_reads () {
+    sed -n 's/^stats: read \([0-9]*\) .*/\1/p' "$HOME"/ddriver_log
+}
+
+function remount () {
+    sleep 1
+    umount "${MNTPOINT}"
+    sleep 1
+}
+
+function check_flush_reads () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 基准：挂载、查看文件、卸载，文件没有数据
+    remount
+    try_mount_or_fail
+    stat "$_PARAM" > /dev/null
+    remount
+    BASE_READS=$(session_reads)
+
+    # 同样的挂载过程，但写入4个完整的块，卸载时刷写这些块
+    try_mount_or_fail
+    if ! dd if=/dev/urandom of="$_PARAM" bs=1024 count=4 conv=notrunc 2>/dev/null; then
+        fail "$_TEST_CASE: 写文件$_PARAM失败"
+        return 1
+    fi
+    remount
+    FLUSH_READS=$(session_reads)
+    try_mount_or_fail
+
+    if [[ -z "${BASE_READS}" ]] || [[ "${FLUSH_READS}" != "${BASE_READS}" ]]; then
+        fail "$_TEST_CASE: 刷写整块数据不应读设备, 基准读请求${BASE_READS}次, 刷写时${FLUSH_READS}次"
+        return 1
+    fi
+    return 0
+}
+
+try_mount_or_fail
+
+touch_and_check "${MNTPOINT}"/file0
+
+TEST_CASE="case 8.1 - full-block flush of ${MNTPOINT}/file0 issues no reads"
+core_tester stat "${MNTPOINT}"/file0 check_flush_reads "$TEST_CASE"
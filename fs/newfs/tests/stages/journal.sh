@@ -0,0 +1,39 @@
+#!/bin/bash
+
+TEST_CASE="case 9 - journal replay"
+
+# 不卸载，直接杀掉文件系统进程，模拟掉电
+function crash () {
+    pkill -9 -x "${PROJECT_NAME}"
+    sleep 1
+    umount -l "${MNTPOINT}" 2>/dev/null
+    fusermount -u "${MNTPOINT}" 2>/dev/null
+    sleep 1
+}
+
+function check_replay () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    try_mount_or_fail
+    mkdir_and_check "${MNTPOINT}"/jdir
+    touch_and_check "${MNTPOINT}"/jdir/jfile
+    echo "journal" > "${MNTPOINT}"/jdir/jfile
+    # 等待后台刷写线程提交事务(默认脏数据最长停留5s)
+    sleep 7
+    crash
+
+    # 重新挂载时重放日志，崩溃前已提交的目录和文件都应存在
+    try_mount_or_fail
+    if [[ ! -d "${MNTPOINT}"/jdir ]] || [[ "$(cat "${MNTPOINT}"/jdir/jfile 2>/dev/null)" != "journal" ]]; then
+        fail "$_TEST_CASE: 崩溃前已提交的$_PARAM在重新挂载后丢失"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+TEST_CASE="case 9.1 - ${MNTPOINT}/jdir survives a crash after commit"
+core_tester true "${MNTPOINT}"/jdir check_replay "$TEST_CASE"
@@ -3,11 +3,43 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
+
+#define DDRIVER_OP_READ     0
+#define DDRIVER_OP_WRITE    1
+
+#define DDRIVER_MAP_READ    0x1
+#define DDRIVER_MAP_WRITE   0x2
+#define DDRIVER_COMMIT_SYNC 0x1
+#define DDRIVER_RWF_FUA     0x1         /* Write through the device cache */
+
+struct ddriver_io
+{
+    int     opcode;             /* DDRIVER_OP_READ / DDRIVER_OP_WRITE */
+    char   *buf;
+    size_t  size;               /* Multiple of IO unit */
+    off_t   offset;             /* Aligned to IO unit */
+    void   *user_data;
+    int     res;                /* Bytes transferred or -errno, set on completion */
+    int     flags;              /* DDRIVER_RWF_* for writes, 0 otherwise */
+};
 
 int ddriver_open(char *path);
 int ddriver_seek(int fd, off_t offset, int whence);
 int ddriver_write(int fd, char *buf, size_t size);
 int ddriver_read(int fd, char *buf, size_t size);
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+int ddriver_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+int ddriver_pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags);
+int ddriver_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+int ddriver_submit(int fd, struct ddriver_io *ios, int nr);
+int ddriver_reap(int fd, struct ddriver_io **ios, int min_nr, int max_nr);
+int ddriver_dispatch(int fd, struct ddriver_io *ios, int nr);
+char *ddriver_map(int fd, off_t offset, size_t size, int prot);
+int ddriver_commit(int fd, off_t offset, size_t size, int flags);
 int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
 int ddriver_close(int fd);
 
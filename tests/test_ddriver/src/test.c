@@ -1,9 +1,10 @@
 #include "../include/ddriver.h"
 #include <linux/fs.h>
+#include <string.h>
 
 int main(int argc, char const *argv[])
 {
-    int size;
+    uint64_t size;
     struct ddriver_state state;
     int fd = ddriver_open("/home/students/200111304/ddriver");
     if (fd < 0) {
@@ -23,7 +24,7 @@ int main(int argc, char const *argv[])
 
     /* Cycle 2: ioctl test - return int */
     ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &size);
-    printf("%d\n", size);
+    printf("%lu\n", size);
 
     /* Cycle 3: ioctl test - return struct */
     ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE, &state);
@@ -35,13 +36,187 @@ int main(int argc, char const *argv[])
     ddriver_ioctl(fd, IOC_REQ_DEVICE_RESET, &size);
 
     ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &size);
-    printf("%d\n", size);
+    printf("%lu\n", size);
 
     ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE, &state);
     printf("read_cnt: %d\n", state.read_cnt);
     printf("write_cnt: %d\n", state.write_cnt);
     printf("seek_cnt: %d\n", state.seek_cnt);
 
+    /* Cycle 5: vectored read/write test - one request for many units */
+    char vbuffer[2][512];
+    char vrbuffer[1024];
+    struct iovec iov[2] = {
+        {.iov_base = vbuffer[0], .iov_len = 512},
+        {.iov_base = vbuffer[1], .iov_len = 512}
+    };
+    struct iovec riov = {.iov_base = vrbuffer, .iov_len = 1024};
+    memset(vbuffer[0], 'b', 512);
+    memset(vbuffer[1], 'c', 512);
+    ddriver_seek(fd, 0, SEEK_SET);
+    ddriver_writev(fd, iov, 2);
+    ddriver_seek(fd, 0, SEEK_SET);
+    ddriver_readv(fd, &riov, 1);
+    if (vrbuffer[0] != 'b' || vrbuffer[1023] != 'c') {
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE, &state);
+    printf("read_cnt: %d\n", state.read_cnt);
+    printf("write_cnt: %d\n", state.write_cnt);
+
+    /* Cycle 6: positional read/write test - no shared head */
+    memset(vbuffer[0], 'd', 512);
+    ddriver_pwrite(fd, vbuffer[0], 512, 1024);
+    ddriver_pread(fd, vrbuffer, 1024, 512);
+    if (vrbuffer[0] != 'c' || vrbuffer[512] != 'd') {
+        return -1;
+    }
+
+    /* Cycle 7: async submit/reap test - requests in flight overlap */
+    struct ddriver_io ios[8];
+    struct ddriver_io *done[8];
+    char abuffer[8][512];
+    int i, reaped = 0;
+    for (i = 0; i < 8; i++) {
+        ios[i].opcode = DDRIVER_OP_READ;
+        ios[i].flags = 0;
+        ios[i].buf = abuffer[i];
+        ios[i].size = 512;
+        ios[i].offset = i * 512;
+    }
+    if (ddriver_submit(fd, ios, 8) != 8) {
+        return -1;
+    }
+    while (reaped < 8) {
+        reaped += ddriver_reap(fd, done + reaped, 1, 8 - reaped);
+    }
+    for (i = 0; i < 8; i++) {
+        if (done[i]->res != 512) {
+            return -1;
+        }
+    }
+    if (abuffer[0][0] != 'b' || abuffer[2][0] != 'd') {
+        return -1;
+    }
+
+    /* Cycle 8: mmap test - zero-copy access and commit */
+    char *mapped = ddriver_map(fd, 1024, 512, DDRIVER_MAP_READ | DDRIVER_MAP_WRITE);
+    if (mapped == NULL || mapped[0] != 'd') {
+        return -1;
+    }
+    mapped[0] = 'e';
+    ddriver_commit(fd, 1024, 512, DDRIVER_COMMIT_SYNC);
+    ddriver_pread(fd, rbuffer, 512, 1024);
+    if (rbuffer[0] != 'e') {
+        return -1;
+    }
+
+    /* Cycle 9: latency profile test - switch model, data unchanged */
+    int profile = DDRIVER_PROFILE_NONE;
+    if (ddriver_ioctl(fd, IOC_REQ_DEVICE_PROFILE, &profile) < 0) {
+        return -1;
+    }
+    ddriver_pread(fd, rbuffer, 512, 1024);
+    if (rbuffer[0] != 'e') {
+        return -1;
+    }
+    profile = DDRIVER_PROFILE_NUM;
+    if (ddriver_ioctl(fd, IOC_REQ_DEVICE_PROFILE, &profile) == 0) {
+        return -1;
+    }
+    profile = DDRIVER_PROFILE_DEFAULT;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_PROFILE, &profile);
+
+    /* Cycle 10: extended state test - 64-bit counters and histograms */
+    struct ddriver_state_ex state_ex;
+    uint64_t lat_total = 0;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE_EX, &state_ex);
+    for (int i = 0; i < DDRIVER_HIST_BUCKETS; i++) {
+        lat_total += state_ex.read_lat_hist[i];
+    }
+    if (state_ex.read_cnt == 0 || lat_total != state_ex.read_cnt ||
+        state_ex.seq_cnt + state_ex.rand_cnt != state_ex.read_cnt + state_ex.write_cnt) {
+        return -1;
+    }
+    printf("read_bytes: %lu, write_bytes: %lu, seq: %lu, rand: %lu\n", 
+           state_ex.read_bytes, state_ex.write_bytes, state_ex.seq_cnt, state_ex.rand_cnt);
+
+    /* Cycle 11: discard test - range reads back zeros */
+    struct ddriver_range range = {.offset = 1024, .size = 512};
+    if (ddriver_ioctl(fd, IOC_REQ_DEVICE_DISCARD, &range) < 0) {
+        return -1;
+    }
+    ddriver_pread(fd, rbuffer, 512, 1024);
+    if (rbuffer[0] != 0) {
+        return -1;
+    }
+    range.offset = 100;
+    if (ddriver_ioctl(fd, IOC_REQ_DEVICE_DISCARD, &range) == 0) {
+        return -1;
+    }
+
+    /* Cycle 12: elevator test - shuffled batch dispatched in one sweep */
+    for (int i = 0; i < 8; i++) {
+        int blk = (i * 5) % 8;                       /* 0 5 2 7 4 1 6 3 */
+        memset(abuffer[i], 'k' + blk, 512);
+        ios[i].opcode = DDRIVER_OP_WRITE;
+        ios[i].flags = 0;
+        ios[i].buf = abuffer[i];
+        ios[i].size = 512;
+        ios[i].offset = 8192 + blk * 512;
+    }
+    if (ddriver_dispatch(fd, ios, 8) != 8) {
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE_EX, &state_ex);
+    if (state_ex.sched_merged != 7 || state_ex.sched_dist_sweep > state_ex.sched_dist_fifo) {
+        return -1;
+    }
+    ddriver_pread(fd, rbuffer, 512, 8192 + 3 * 512);
+    if (rbuffer[0] != 'k' + 3) {
+        return -1;
+    }
+
+    /* Cycle 13: write cache test - unflushed writes die with a crash, flushed ones survive */
+    uint64_t wcache = 16 * 512;
+    if (ddriver_ioctl(fd, IOC_REQ_DEVICE_WCACHE, &wcache) < 0) {
+        return -1;
+    }
+    memset(buffer, 'x', 512);
+    ddriver_pwrite(fd, buffer, 512, 8192);
+    ddriver_pread(fd, rbuffer, 512, 8192);
+    if (rbuffer[0] != 'x') {                         /* Served from the cache */
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_CRASH, NULL);
+    ddriver_pread(fd, rbuffer, 512, 8192);
+    if (rbuffer[0] != 'k') {                         /* Cycle 12 data is back */
+        return -1;
+    }
+    ddriver_pwrite(fd, buffer, 512, 8192);
+    ddriver_ioctl(fd, IOC_REQ_FLUSH, NULL);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_CRASH, NULL);
+    ddriver_pread(fd, rbuffer, 512, 8192);
+    if (rbuffer[0] != 'x') {
+        return -1;
+    }
+    struct iovec fua = {.iov_base = buffer, .iov_len = 512};
+    memset(buffer, 'y', 512);
+    ddriver_pwritev2(fd, &fua, 1, 8192 + 512, DDRIVER_RWF_FUA);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_CRASH, NULL);
+    ddriver_pread(fd, rbuffer, 512, 8192 + 512);
+    if (rbuffer[0] != 'y') {
+        return -1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE_EX, &state_ex);
+    printf("wcache: absorbed %lu, hits %lu, lost %lu bytes\n", state_ex.wcache_absorbed,
+           state_ex.wcache_read_hits, state_ex.wcache_lost_bytes);
+    if (state_ex.wcache_lost_bytes != 512 || state_ex.wcache_flushes != 1) {
+        return -1;
+    }
+    wcache = 0;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_WCACHE, &wcache);
+
     ddriver_close(fd);
 
     printf("Test Pass :)\n");